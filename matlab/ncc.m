@@ -56,9 +56,8 @@ end
 
 function [state, location] = ncc_initialize(I, region, varargin)
 
-    gray = double(rgb2gray(I));
-
-    [height, width] = size(gray);
+    height = size(I, 1);
+    width = size(I, 2);
 
     % If the provided region is a polygon ...
     if numel(region) > 4
@@ -78,12 +77,21 @@ function [state, location] = ncc_initialize(I, region, varargin)
     x2 = min(width-2, region(1) + region(3) - 1);
     y2 = min(height-2, region(2) + region(4) - 1);
 
-    template = gray((y1:y2)+1, (x1:x2)+1);
+    template = ncc_crop(I, (y1:y2)+1, (x1:x2)+1);
 
     state = struct('template', template, 'size', [x2 - x1 + 1, y2 - y1 + 1]);
     state.window = max(state.size) * 2;
     state.position = [x1 + x2 + 1, y1 + y2 + 1] / 2;
 
+    % The search window is never larger than this, so the template spectrum
+    % is computed once for a fixed transform size
+    state.fft_size = repmat(2 ^ nextpow2(state.window + 2), 1, 2);
+
+    zero_mean = template - mean(template(:));
+    state.count = numel(template);
+    state.energy = sum(double(zero_mean(:)) .^ 2);
+    state.spectrum = conj(fft2(zero_mean, state.fft_size(1), state.fft_size(2)));
+
     location = [x1, y1, state.size];
 
 end
@@ -91,33 +99,35 @@ end
 function [state, location, confidence] = ncc_update(state, I, varargin)
 
     confidence = 0;
-    gray = double(rgb2gray(I)) ;
 
-    [height, width] = size(gray);
+    height = size(I, 1);
+    width = size(I, 2);
 
     x1 = max(1, round(state.position(1) - state.window / 2));
     y1 = max(1, round(state.position(2) - state.window / 2));
     x2 = min(width-2, round(state.position(1) + state.window / 2));
     y2 = min(height-2, round(state.position(2) + state.window / 2));
 
-    region = gray((y1:y2)+1, (x1:x2)+1);
+    region = ncc_crop(I, (y1:y2)+1, (x1:x2)+1);
 
     if any(size(region) < size(state.template))
         location = [state.position - state.size / 2, state.size];
         return;
     end;
 
-    C = normxcorr2(state.template, region);
+    C = ncc_response(state, region);
 
     % We are only using valid part of the response (where full template is used)
     pad = size(state.template) - 1;
     center = size(region) - pad - 1;
-    C = C([false(1,pad(1)) true(1,center(1))], [false(1,pad(2)) true(1,center(2))]);
+    C = C(1:center(1), 1:center(2));
 
     x1 = x1 + pad(2);
     y1 = y1 + pad(1);
     [confidence, imax] = max(C(:));
+    confidence = double(confidence);
     if isempty(imax)
+        confidence = 0;
         mx = 0;
         my = 0;
     else
@@ -130,3 +140,49 @@ function [state, location, confidence] = ncc_update(state, I, varargin)
     location = [position - state.size / 2, state.size];
 
 end
+
+function gray = ncc_crop(I, rows, columns)
+% Crops the image before the conversion, so only the used pixels are converted
+
+    patch = I(rows, columns, :);
+
+    if size(patch, 3) == 3
+        patch = rgb2gray(patch);
+    end;
+
+    gray = single(patch);
+
+end
+
+function C = ncc_response(state, region)
+% Normalized cross correlation of the template with every position where it
+% fits into the region, same as the valid part of normxcorr2. The numerator
+% is computed with the cached template spectrum, local sums of the region
+% with integral images (in double precision, their differences cancel).
+
+    [th, tw] = size(state.template);
+    [rh, rw] = size(region);
+
+    F = fft2(region, state.fft_size(1), state.fft_size(2));
+    numerator = real(ifft2(F .* state.spectrum));
+    numerator = numerator(1:rh - th + 1, 1:rw - tw + 1);
+
+    values = double(region);
+    S = zeros(rh + 1, rw + 1);
+    Q = zeros(rh + 1, rw + 1);
+    S(2:end, 2:end) = cumsum(cumsum(values, 1), 2);
+    Q(2:end, 2:end) = cumsum(cumsum(values .^ 2, 1), 2);
+
+    rows = 1:rh - th + 1;
+    columns = 1:rw - tw + 1;
+
+    total = S(rows + th, columns + tw) - S(rows, columns + tw) - S(rows + th, columns) + S(rows, columns);
+    squares = Q(rows + th, columns + tw) - Q(rows, columns + tw) - Q(rows + th, columns) + Q(rows, columns);
+
+    denominator = sqrt(max(squares - total .^ 2 / state.count, 0) * state.energy);
+
+    C = zeros(size(numerator), 'single');
+    valid = denominator > sqrt(eps(max(denominator(:))));
+    C(valid) = single(double(numerator(valid)) ./ denominator(valid));
+
+end
@@ -43,10 +43,26 @@
 #define VOT_RECTANGLE
 #include "vot.h"
 
+#define SCALE_PENALTY 0.98
+
 class NCCTracker
 {
 public:
 
+    /**
+     * Scale search is enabled with a scale step larger than one. Templates for
+     * scales step^k, k = -levels..levels, are resampled once at init and each
+     * frame the current scale and its two neighbours are matched against the
+     * same search window.
+     *
+     * With a positive update rate the matched template is blended with the
+     * matched patch (an exponentially weighted average) in frames where the
+     * confidence reaches the update threshold, so occluders are not learned.
+     */
+    NCCTracker(float scale_step = 1, int scale_levels = 7, float update_rate = 0, float update_threshold = 0.7f) :
+        p_scale_step(scale_step), p_scale_levels(scale_step > 1 ? MAX(scale_levels, 0) : 0),
+        p_update_rate(update_rate), p_update_threshold(update_threshold) {}
+
     inline void init(cv::Mat & img, cv::Rect rect)
     {
         p_window = MAX(rect.width, rect.height) * 2;
@@ -68,27 +84,73 @@ public:
         p_position.y = (float)rect.y + (float)rect.height / 2;
 
         p_size = cv::Size2f(rect.width, rect.height);
+        p_base_size = p_size;
+
+        p_templates.clear();
+        p_templates.resize(2 * p_scale_levels + 1);
+        p_accumulators.clear();
+        p_accumulators.resize(p_templates.size());
+        p_level = p_scale_levels;
+
+        for (int i = 0; i < (int) p_templates.size(); i++) {
+
+            float scale = pow(p_scale_step, i - p_scale_levels);
+            cv::Size size(MAX(1, (int) round(p_template.cols * scale)), MAX(1, (int) round(p_template.rows * scale)));
+
+            if (i == p_scale_levels)
+                p_templates[i] = p_template;
+            else
+                cv::resize(p_template, p_templates[i], size, 0, 0, scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+
+        }
 
     }
 
-    inline cv::Rect track(cv::Mat img, float& confidence)
+    /**
+     * Search window for the next frame in image coordinates, it is clipped to
+     * the image when tracking.
+     */
+    inline cv::Rect window() const
+    {
+        int left = (int) round(p_position.x - (float)p_window / 2);
+        int top = (int) round(p_position.y - (float)p_window / 2);
+
+        return cv::Rect(left, top, (int) round(p_position.x + (float)p_window / 2) - left, (int) round(p_position.y + (float)p_window / 2) - top);
+    }
+
+    /**
+     * The image may be a crop that contains the search window, offset is its
+     * position in the full image of the given size (by default the image is
+     * not cropped).
+     */
+    inline cv::Rect track(cv::Mat img, float& confidence, cv::Point offset = cv::Point(), cv::Size size = cv::Size())
     {
 
         confidence = 0;
 
-        cv::Mat gray;
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+        if (size.empty())
+            size = img.size();
 
         float left = MAX(round(p_position.x - (float)p_window / 2), 0);
         float top = MAX(round(p_position.y - (float)p_window / 2), 0);
 
-        float right = MIN(round(p_position.x + (float)p_window / 2), gray.cols - 1);
-        float bottom = MIN(round(p_position.y + (float)p_window / 2), gray.rows - 1);
+        float right = MIN(round(p_position.x + (float)p_window / 2), size.width - 1);
+        float bottom = MIN(round(p_position.y + (float)p_window / 2), size.height - 1);
 
         cv::Rect roi((int) left, (int) top, (int) (right - left), (int) (bottom - top));
 
-        if (roi.width < p_template.cols || roi.height < p_template.rows) {
-            cv::Rect result;
+        cv::Rect result;
+
+        // Candidate scales are the current one and its neighbours in the template bank
+        int levels[3];
+        int count = 0;
+
+        for (int i = MAX(p_level - 1, 0); i <= MIN(p_level + 1, (int) p_templates.size() - 1); i++) {
+            if (roi.width >= p_templates[i].cols && roi.height >= p_templates[i].rows)
+                levels[count++] = i;
+        }
+
+        if (count == 0) {
 
             result.x = p_position.x - p_size.width / 2;
             result.y = p_position.y - p_size.height / 2;
@@ -98,18 +160,44 @@ public:
 
         }
 
-        cv::Mat matches;
-        cv::Mat cut = gray(roi);
+        // Only the search window is converted to grayscale
+        cv::Mat cut;
+        cv::cvtColor(img(roi - offset), cut, cv::COLOR_BGR2GRAY);
+        double values[3];
+        cv::Point locations[3];
+
+        cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; i++) {
+                cv::Mat matches;
+                cv::matchTemplate(cut, p_templates[levels[i]], matches, cv::TM_CCOEFF_NORMED);
+                cv::minMaxLoc(matches, NULL, &values[i], NULL, &locations[i], cv::Mat());
+            }
+        });
+
+        // A small penalty on scale changes keeps the size stable when responses are similar
+        int best = 0;
+
+        for (int i = 1; i < count; i++) {
+            double value = levels[i] == p_level ? values[i] : values[i] * SCALE_PENALTY;
+            double current = levels[best] == p_level ? values[best] : values[best] * SCALE_PENALTY;
+            if (value > current)
+                best = i;
+        }
 
-        cv::matchTemplate(cut, p_template, matches, cv::TM_CCOEFF_NORMED);
+        confidence = (float) values[best];
 
-        cv::Point matchLoc;
-        double matchVal;
-        cv::minMaxLoc(matches, NULL, &matchVal, NULL, &matchLoc, cv::Mat());
+        if (levels[best] != p_level) {
+            resample(p_level, levels[best]);
+            p_level = levels[best];
+            float scale = pow(p_scale_step, p_level - p_scale_levels);
+            p_size = cv::Size2f(p_base_size.width * scale, p_base_size.height * scale);
+            p_window = MAX(p_size.width, p_size.height) * 2;
+        }
 
-        confidence = (float) matchVal;
+        if (p_update_rate > 0 && confidence >= p_update_threshold)
+            update(cut, locations[best], levels[best]);
 
-        cv::Rect result;
+        cv::Point matchLoc = locations[best];
 
         p_position.x = left + matchLoc.x + (float)p_size.width / 2;
         p_position.y = top + matchLoc.y + (float)p_size.height / 2;
@@ -123,40 +211,119 @@ public:
     }
 
 private:
+
+    // Blends the template with the matched patch, the running average is kept in floating point to avoid rounding drift
+    inline void update(const cv::Mat& cut, cv::Point location, int level)
+    {
+        cv::Mat& templ = p_templates[level];
+        cv::Mat& accumulator = p_accumulators[level];
+
+        if (accumulator.empty())
+            templ.convertTo(accumulator, CV_32F);
+
+        cv::accumulateWeighted(cut(cv::Rect(location, templ.size())), accumulator, p_update_rate);
+        accumulator.convertTo(templ, CV_8U);
+    }
+
+    // Carries the learned appearance to a new scale, otherwise its template would still be the initial one
+    inline void resample(int from, int to)
+    {
+        if (p_accumulators[from].empty())
+            return;
+
+        cv::resize(p_accumulators[from], p_accumulators[to], p_templates[to].size(), 0, 0, to < from ? cv::INTER_AREA : cv::INTER_LINEAR);
+        p_accumulators[to].convertTo(p_templates[to], CV_8U);
+    }
+
     cv::Point2f p_position;
 
-    cv::Size p_size;
+    cv::Size2f p_size;
+
+    cv::Size2f p_base_size;
 
     float p_window;
 
     cv::Mat p_template;
+
+    float p_scale_step;
+
+    int p_scale_levels;
+
+    // Templates resampled for all scales, the original template is in the middle
+    std::vector<cv::Mat> p_templates;
+
+    // Running averages of updated templates
+    std::vector<cv::Mat> p_accumulators;
+
+    float p_update_rate;
+
+    float p_update_threshold;
+
+    int p_level;
 };
 
 int main( int argc, char** argv) {
 
-    NCCTracker tracker;
+    // Run with --scale to enable scale search, with --update to enable template update and with --budget followed by
+    // milliseconds to skip frames that would not be tracked in time
+    bool scale = false, update = false;
+    double budget = 0;
+
+    for (int i = 1; i < argc; i++) {
+        scale |= string(argv[i]) == "--scale";
+        update |= string(argv[i]) == "--update";
+        if (string(argv[i]) == "--budget" && i + 1 < argc)
+            budget = atof(argv[++i]) / 1000;
+    }
+
+    NCCTracker tracker(scale ? 1.05f : 1.0f, 14, update ? 0.05f : 0.0f);
     VOT vot;
+    VOTFrameLoader loader;
+    VOTBudget deadline(budget);
 
     cv::Rect initialization;
     initialization << vot.region();
-    cv::Mat image = cv::imread(vot.frame());
+    cv::Mat image = loader.load(vot.frame(), "").color;
     tracker.init(image, initialization);
 
+    // Without a budget no time is measured
+    if (deadline.enabled())
+        deadline.reset(0, vot.region());
+
     while (!vot.end()) {
 
-        string imagepath = vot.frame();
+        const string& imagepath = vot.frame();
 
         if (imagepath.empty()) break;
 
-        cv::Mat image = cv::imread(imagepath);
+        if (deadline.enabled()) {
+
+            deadline.start();
+
+            // A skipped frame is not decoded, the tracker continues from its last position on the next one
+            if (!deadline.admit(0)) {
+                vot.report(deadline.skip(0), 0);
+                continue;
+            }
+
+        }
+
+        VOTBudget::clock::time_point begin = deadline.enabled() ? VOTBudget::clock::now() : VOTBudget::clock::time_point();
+
+        // Only the search window of the tracker is decoded
+        loader.roi(tracker.window());
+
+        const VOTFrame& frame = loader.load(imagepath, "");
 
         float confidence;
 
-        cv::Rect rect = tracker.track(image, confidence);
+        cv::Rect rect = tracker.track(frame.color, confidence, frame.offset, frame.size);
+
+        if (deadline.enabled())
+            deadline.measured(0, VOTRegion(rect), std::chrono::duration<double>(VOTBudget::clock::now() - begin).count(), confidence);
 
         vot.report(rect, confidence);
 
     }
 
 }
-
@@ -0,0 +1,349 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * This is an example of a multi-object tracker that tracks all objects in a
+ * single pass. It uses normalized cross correlation like the NCC example, but
+ * the grayscale frame and the integral images used for normalization are
+ * computed once and shared by all objects.
+ * The main function of this example is to show the developers how to modify
+ * their trackers to work with the evaluation environment.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <iostream>
+#include <limits>
+#include <stdio.h>
+
+#define VOT_MULTI_OBJECT
+#define VOT_RECTANGLE
+#include "vot.h"
+
+class NCCMultiTracker
+{
+public:
+
+    /**
+     * Adds an object, returns its index. The image has to be grayscale.
+     */
+    inline int add(const cv::Mat& gray, cv::Rect rect)
+    {
+        Object object;
+
+        int left = MAX(rect.x, 0);
+        int top = MAX(rect.y, 0);
+
+        int right = MIN(rect.x + rect.width, gray.cols - 1);
+        int bottom = MIN(rect.y + rect.height, gray.rows - 1);
+
+        gray(cv::Rect(left, top, right - left, bottom - top)).copyTo(object.templ);
+
+        cv::Scalar mean, deviation;
+        cv::meanStdDev(object.templ, mean, deviation);
+
+        object.mean = mean[0];
+        object.energy = deviation[0] * deviation[0] * object.templ.total();
+        object.position = cv::Point2f((float)rect.x + (float)rect.width / 2, (float)rect.y + (float)rect.height / 2);
+        object.size = cv::Size2f(rect.width, rect.height);
+        object.window = MAX(rect.width, rect.height) * 2;
+        object.result = rect;
+        object.confidence = 0;
+        object.active = true;
+
+        p_objects.push_back(object);
+
+        return (int) p_objects.size() - 1;
+    }
+
+    /**
+     * Tracks all objects in a new grayscale frame. Search windows that overlap
+     * are grouped and the integral images of a group region are computed once
+     * for all of its objects. Each window is correlated with the raw template
+     * and normalized with the shared sums, which gives the same responses as
+     * TM_CCOEFF_NORMED.
+     */
+    inline void track(const cv::Mat& gray)
+    {
+        std::vector<cv::Rect> windows(p_objects.size());
+
+        for (size_t i = 0; i < p_objects.size(); i++) {
+            if (!p_objects[i].active)
+                continue;
+
+            windows[i] = window(p_objects[i], gray.size());
+
+            if (windows[i].empty()) {
+                Object& object = p_objects[i];
+                object.result = cv::Rect(object.position.x - object.size.width / 2, object.position.y - object.size.height / 2,
+                    object.size.width, object.size.height);
+                object.confidence = 0;
+            }
+        }
+
+        std::vector<Group> groups = merge(windows);
+
+        cv::parallel_for_(cv::Range(0, (int) groups.size()), [&](const cv::Range& range) {
+            for (int g = range.start; g < range.end; g++) {
+
+                const Group& group = groups[g];
+                cv::Mat region = gray(group.region);
+                cv::Mat sums, squares, matches;
+
+                cv::integral(region, sums, squares, CV_64F, CV_64F);
+
+                for (int i : group.members) {
+                    Object& object = p_objects[i];
+                    // Window relative to the group region
+                    cv::Rect roi = windows[i] - group.region.tl();
+
+                    cv::matchTemplate(region(roi), object.templ, matches, cv::TM_CCORR);
+
+                    cv::Point location;
+                    float confidence = normalize(matches, sums, squares, roi.tl(), object, location);
+
+                    location += roi.tl() + group.region.tl();
+
+                    object.position.x = location.x + object.size.width / 2;
+                    object.position.y = location.y + object.size.height / 2;
+                    object.result = cv::Rect(location.x, location.y, object.size.width, object.size.height);
+                    object.confidence = confidence;
+                }
+
+            }
+        });
+
+        p_frames++;
+    }
+
+    inline const cv::Rect& result(int i) const { return p_objects[i].result; }
+
+    inline float confidence(int i) const { return p_objects[i].confidence; }
+
+    // Number of frames tracked so far
+    inline int frames() const { return p_frames; }
+
+    // Stops tracking an object, its index stays valid
+    inline void remove(int i) { p_objects[i].active = false; }
+
+    // Removes all objects
+    inline void clear() { p_objects.clear(); p_frames = 0; }
+
+private:
+
+    struct Object {
+        cv::Mat templ;
+        double mean;
+        double energy;
+        cv::Point2f position;
+        cv::Size2f size;
+        float window;
+        cv::Rect result;
+        float confidence;
+        bool active;
+    };
+
+    struct Group {
+        cv::Rect region;
+        std::vector<int> members;
+    };
+
+    // Search window of an object (same as in the NCC example), empty if the template does not fit into it
+    static inline cv::Rect window(const Object& object, cv::Size size)
+    {
+        float left = MAX(round(object.position.x - object.window / 2), 0);
+        float top = MAX(round(object.position.y - object.window / 2), 0);
+
+        float right = MIN(round(object.position.x + object.window / 2), size.width - 1);
+        float bottom = MIN(round(object.position.y + object.window / 2), size.height - 1);
+
+        cv::Rect roi((int) left, (int) top, (int) (right - left), (int) (bottom - top));
+
+        if (roi.width < object.templ.cols || roi.height < object.templ.rows)
+            return cv::Rect();
+
+        return roi;
+    }
+
+    // Groups overlapping windows, two groups are merged only if their union is not larger than both together
+    static inline std::vector<Group> merge(const std::vector<cv::Rect>& windows)
+    {
+        std::vector<Group> groups;
+
+        for (size_t i = 0; i < windows.size(); i++) {
+            if (!windows[i].empty())
+                groups.push_back(Group{windows[i], std::vector<int>(1, (int) i)});
+        }
+
+        bool merged = true;
+
+        while (merged) {
+            merged = false;
+            for (size_t a = 0; a < groups.size() && !merged; a++) {
+                for (size_t b = a + 1; b < groups.size() && !merged; b++) {
+                    const cv::Rect& ra = groups[a].region;
+                    const cv::Rect& rb = groups[b].region;
+                    if ((ra & rb).empty())
+                        continue;
+                    cv::Rect join = ra | rb;
+                    if (join.area() > ra.area() + rb.area())
+                        continue;
+                    groups[a].region = join;
+                    groups[a].members.insert(groups[a].members.end(), groups[b].members.begin(), groups[b].members.end());
+                    groups.erase(groups.begin() + b);
+                    merged = true;
+                }
+            }
+        }
+
+        return groups;
+    }
+
+    // Turns raw correlations into normalized ones using box sums from the integral images, returns the best response
+    static inline float normalize(const cv::Mat& matches, const cv::Mat& sums, const cv::Mat& squares, cv::Point offset,
+        const Object& object, cv::Point& location)
+    {
+        int th = object.templ.rows, tw = object.templ.cols;
+        double count = (double) th * tw;
+        double best = -std::numeric_limits<double>::infinity();
+
+        location = cv::Point(0, 0);
+
+        for (int y = 0; y < matches.rows; y++) {
+            const float* correlation = matches.ptr<float>(y);
+            const double* s0 = sums.ptr<double>(offset.y + y) + offset.x;
+            const double* s1 = sums.ptr<double>(offset.y + y + th) + offset.x;
+            const double* q0 = squares.ptr<double>(offset.y + y) + offset.x;
+            const double* q1 = squares.ptr<double>(offset.y + y + th) + offset.x;
+
+            for (int x = 0; x < matches.cols; x++) {
+                double total = s1[x + tw] - s0[x + tw] - s1[x] + s0[x];
+                double square = q1[x + tw] - q0[x + tw] - q1[x] + q0[x];
+                double denominator = sqrt(MAX(square - total * total / count, 0) * object.energy);
+                double response = denominator > 1e-6 ? (correlation[x] - total * object.mean) / denominator : 0;
+
+                if (response > best) {
+                    best = response;
+                    location = cv::Point(x, y);
+                }
+            }
+        }
+
+        return (float) best;
+    }
+
+    std::vector<Object> p_objects;
+
+    int p_frames = 0;
+};
+
+/**
+ * Adapter for the manager, all objects share one engine and the first object
+ * that receives a new frame tracks all of them.
+ */
+class Tracker : public VOTFrameTracker {
+
+public:
+    // Only color images are decoded, once per frame for all objects
+    static constexpr int channels = TRAX_CHANNEL_COLOR;
+
+    Tracker(const VOTFrame& frame, const VOTRegion& region) : VOTFrameTracker(frame, region) {
+
+        cv::Rect initialization;
+        initialization << region;
+
+        cv::Mat gray;
+        cv::cvtColor(frame.color, gray, cv::COLOR_BGR2GRAY);
+        index = engine.add(gray, initialization);
+        instances++;
+
+        // Objects may start on a later frame, this frame is already tracked
+        frames = engine.frames();
+
+    }
+
+    virtual ~Tracker() {
+
+        // The manager replaces all trackers on reinitialization
+        if (--instances == 0)
+            engine.clear();
+        else
+            engine.remove(index);
+
+    }
+
+    virtual VOTRegion update(const VOTFrame& frame) {
+
+        if (++frames > engine.frames()) {
+            cv::Mat gray;
+            cv::cvtColor(frame.color, gray, cv::COLOR_BGR2GRAY);
+            engine.track(gray);
+        }
+
+        return engine.result(index);
+
+    }
+
+    float confidence() const {
+        return engine.confidence(index);
+    }
+
+    // A skipped object still counts the frame, the next object to update tracks it
+    void skip() {
+        frames++;
+    }
+
+private:
+
+    static NCCMultiTracker engine;
+
+    static int instances;
+
+    int index;
+
+    int frames = 0;
+
+};
+
+NCCMultiTracker Tracker::engine;
+
+int Tracker::instances = 0;
+
+int main( int argc, char** argv) {
+
+    VOTManager<Tracker> vot;
+
+    // Run with --budget followed by milliseconds to extrapolate objects that would not be tracked in time
+    for (int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) == "--budget")
+            vot.budget(atof(argv[i + 1]) / 1000);
+    }
+
+    vot.run();
+
+}
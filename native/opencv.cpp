@@ -48,26 +48,29 @@
 #define TRACKER TrackerCSRT
 #endif
 
-class Tracker : public VOTTracker {
+class Tracker : public VOTFrameTracker {
 
 public:
-    Tracker(const VOTImage& image, const VOTRegion& region) : VOTTracker(image, region) {
+    // Only color images are decoded, once per frame for all objects
+    static constexpr int channels = TRAX_CHANNEL_COLOR;
+
+    // Each object has its own OpenCV tracker, objects can be updated concurrently
+    static constexpr bool parallel = true;
+
+    Tracker(const VOTFrame& frame, const VOTRegion& region) : VOTFrameTracker(frame, region) {
 
         tracker = cv::TRACKER::create().dynamicCast<cv::Tracker>();
         cv::Rect initialization;
         initialization << region;
-        cv::Mat frame = cv::imread(image.color);
-        tracker->init(frame, cv::Rect2d(initialization));
+        tracker->init(frame.color, cv::Rect2d(initialization));
 
     }
 
-    virtual VOTRegion update(const VOTImage& image) {
-
-        cv::Mat frame = cv::imread(image.color);
+    virtual VOTRegion update(const VOTFrame& frame) {
 
         cv::Rect rect;
 
-        bool ok = tracker->update(frame, rect);
+        bool ok = tracker->update(frame.color, rect);
 
         if (!ok) {
             std::cout << "Not ok" << std::endl;
@@ -39,9 +39,11 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <time.h>
 
 #include <trax.h>
 
+// Initial size of the path storage, longer paths are accommodated
 #define VOT_READ_BUFFER 2024
 #define VOT_MAX_OBJECTS 100
 
@@ -71,30 +73,77 @@
     #define _VOT_REGION 2
 #endif
 
-typedef struct vot_image {
 #ifdef VOT_RGBD
-    char color[VOT_READ_BUFFER];
-    char depth[VOT_READ_BUFFER];
+    #define _VOT_CHANNELS (TRAX_CHANNEL_COLOR | TRAX_CHANNEL_DEPTH)
 #elif defined(VOT_IR)
-    char ir[VOT_READ_BUFFER];
+    #define _VOT_CHANNELS TRAX_CHANNEL_IR
 #elif defined(VOT_RGBT)
-    char color[VOT_READ_BUFFER];
-    char ir[VOT_READ_BUFFER];
+    #define _VOT_CHANNELS (TRAX_CHANNEL_COLOR | TRAX_CHANNEL_IR)
+#else
+    #define _VOT_CHANNELS TRAX_CHANNEL_COLOR
+#endif
+
+#ifdef VOT_MULTI_OBJECT
+    #define _VOT_FLAGS TRAX_METADATA_MULTI_OBJECT
+#else
+    #define _VOT_FLAGS 0
+#endif
+
+// Define VOT_REINITIALIZE if the tracker handles reinitialization requests that arrive
+// instead of a frame (see vot_reset), otherwise the wrapper quits when it gets one
+#ifdef VOT_REINITIALIZE
+    #define _VOT_REINITIALIZE 1
 #else
-    char color[VOT_READ_BUFFER];
+    #define _VOT_REINITIALIZE 0
 #endif
+
+// Functions used every frame are always defined in the header (VOT_INLINE). Setup and
+// teardown functions (VOT_API) are compiled once if VOT_LIBRARY is defined, either by
+// linking the vot library target or by defining VOT_IMPLEMENTATION in one source file.
+#ifdef __cplusplus
+    #define VOT_INLINE inline
+#else
+    #define VOT_INLINE static inline
+#endif
+
+#ifdef VOT_LIBRARY
+    #define VOT_API
+#else
+    #define VOT_API VOT_INLINE
+#endif
+
+/**
+ * Image paths of the current frame. The strings are owned by the wrapper and
+ * are valid until the next call to vot_frame, channels that were not
+ * requested are empty.
+ */
+typedef struct vot_image {
+    const char* color;
+    const char* depth;
+    const char* ir;
 } vot_image;
 
-#if _VOT_REGION == 1
 
-typedef struct vot_region {
+typedef struct vot_rectangle {
     float x;
     float y;
     float width;
     float height;
-} vot_region;
+} vot_rectangle;
+
+typedef struct vot_polygon {
+    float* x;
+    float* y;
+    int count;
+} vot_polygon;
 
-void vot_region_release(vot_region** region) {
+typedef struct vot_mask {
+    int width;
+    int height;
+    char* data;
+} vot_mask;
+
+VOT_INLINE void vot_rectangle_release(vot_rectangle** region) {
 
     if (!(*region)) return;
 
@@ -104,8 +153,8 @@ void vot_region_release(vot_region** region) {
 
 }
 
-vot_region* vot_region_create() {
-    vot_region* region = (vot_region*) malloc(sizeof(vot_region));
+VOT_INLINE vot_rectangle* vot_rectangle_create() {
+    vot_rectangle* region = (vot_rectangle*) malloc(sizeof(vot_rectangle));
     region->x = 0;
     region->y = 0;
     region->width = 0;
@@ -113,8 +162,8 @@ vot_region* vot_region_create() {
     return region;
 }
 
-vot_region* vot_region_copy(const vot_region* region) {
-    vot_region* copy = vot_region_create();
+VOT_INLINE vot_rectangle* vot_rectangle_copy(const vot_rectangle* region) {
+    vot_rectangle* copy = vot_rectangle_create();
     copy->x = region->x;
     copy->y = region->y;
     copy->width = region->width;
@@ -122,15 +171,7 @@ vot_region* vot_region_copy(const vot_region* region) {
     return copy;
 }
 
-#endif
-#if _VOT_REGION == 2
-typedef struct vot_region {
-    float* x;
-    float* y;
-    int count;
-} vot_region;
-
-void vot_region_release(vot_region** region) {
+VOT_INLINE void vot_polygon_release(vot_polygon** region) {
     if (!(*region)) return;
 
     if ((*region)->x) {
@@ -147,8 +188,8 @@ void vot_region_release(vot_region** region) {
     *region = NULL;
 }
 
-vot_region* vot_region_create(int n) {
-    vot_region* region = (vot_region*) malloc(sizeof(vot_region));
+VOT_INLINE vot_polygon* vot_polygon_create(int n) {
+    vot_polygon* region = (vot_polygon*) malloc(sizeof(vot_polygon));
     region->x = (float *) malloc(sizeof(float) * n);
     region->y = (float *) malloc(sizeof(float) * n);
     memset(region->x, 0, sizeof(float) * n);
@@ -157,8 +198,8 @@ vot_region* vot_region_create(int n) {
     return region;
 }
 
-vot_region* vot_region_copy(const vot_region* region) {
-    vot_region* copy = vot_region_create(region->count);
+VOT_INLINE vot_polygon* vot_polygon_copy(const vot_polygon* region) {
+    vot_polygon* copy = vot_polygon_create(region->count);
     int i;
     for (i = 0; i < region->count; i++) {
         copy->x[i] = region->x[i];
@@ -166,16 +207,8 @@ vot_region* vot_region_copy(const vot_region* region) {
     }
     return copy;
 }
-#endif
-
-#if _VOT_REGION == 3
-typedef struct vot_region {
-    int width;
-    int height;
-    char* data;
-} vot_region;
 
-void vot_region_release(vot_region** region) {
+VOT_INLINE void vot_mask_release(vot_mask** region) {
 
     if (!(*region)) return;
     free((*region)->data);
@@ -184,163 +217,435 @@ void vot_region_release(vot_region** region) {
 
 }
 
-vot_region* vot_region_create(int width, int height) {
-    vot_region* region = (vot_region*) malloc(sizeof(vot_region));
+VOT_INLINE vot_mask* vot_mask_create(int width, int height) {
+    vot_mask* region = (vot_mask*) malloc(sizeof(vot_mask));
     region->width = width;
     region->height = height;
     region->data = (char*) malloc(sizeof(char) * width * height);
-    memset(region->data, sizeof(char) * width * height, 0);
+    memset(region->data, 0, sizeof(char) * width * height);
     return region;
 }
 
-vot_region* vot_region_copy(const vot_region* region) {
-    vot_region* copy = vot_region_create(region->width, region->height);
+VOT_INLINE vot_mask* vot_mask_copy(const vot_mask* region) {
+    vot_mask* copy = vot_mask_create(region->width, region->height);
     memcpy(copy->data, region->data, region->width * region->height);
     return copy;
 }
 
+VOT_INLINE vot_rectangle* _trax_to_rectangle(const trax_region* _trax_region) {
+    vot_rectangle* region = vot_rectangle_create();
+    assert(trax_region_get_type(_trax_region) == TRAX_REGION_RECTANGLE);
+    trax_region_get_rectangle(_trax_region, &(region->x), &(region->y), &(region->width), &(region->height));
+    return region;
+}
+
+VOT_INLINE trax_region* _rectangle_to_trax(const vot_rectangle* region) {
+    return trax_region_create_rectangle(region->x, region->y, region->width, region->height);
+}
+
+VOT_INLINE vot_polygon* _trax_to_polygon(const trax_region* _trax_region) {
+    int i;
+    int count = trax_region_get_polygon_count(_trax_region);
+    vot_polygon* region = vot_polygon_create(count);
+    for (i = 0; i < count; i++)
+        trax_region_get_polygon_point(_trax_region, i, &(region->x[i]), &(region->y[i]));
+    return region;
+}
+
+VOT_INLINE trax_region* _polygon_to_trax(const vot_polygon* region) {
+    int i;
+    trax_region* _trax_region = trax_region_create_polygon(region->count);
+    assert(trax_region_get_type(_trax_region) == TRAX_REGION_POLYGON);
+    for (i = 0; i < region->count; i++)
+        trax_region_set_polygon_point(_trax_region, i, region->x[i], region->y[i]);
+    return _trax_region;
+}
+
+VOT_INLINE vot_mask* _trax_to_mask(const trax_region* _trax_region) {
+    int x, y, width, height, i;
+    trax_region_get_mask_header(_trax_region, &x, &y, &width, &height);
+    vot_mask* region = vot_mask_create(x + width, y + height);
+
+    for (i = 0; i < height; i++) {
+        memcpy(&(region->data[(width + x) * (i + y) + x]), trax_region_get_mask_row(_trax_region, i), width * sizeof(char));
+    }
+
+    return region;
+}
+
+VOT_INLINE trax_region* _mask_to_trax(const vot_mask* region) {
+
+    trax_region* _trax_region = trax_region_create_mask(0, 0, region->width, region->height);
+    memcpy(trax_region_write_mask_row(_trax_region, 0), region->data, region->width * region->height * sizeof(char));
+    return _trax_region;
+
+}
+
+// The region type used by the C API (and as a default by the C++ API) is selected at compile time
+
+#if _VOT_REGION == 1
+
+typedef vot_rectangle vot_region;
+
+VOT_INLINE void vot_region_release(vot_region** region) {
+    vot_rectangle_release(region);
+}
+
+VOT_INLINE vot_region* vot_region_create() {
+    return vot_rectangle_create();
+}
+
+VOT_INLINE vot_region* vot_region_copy(const vot_region* region) {
+    return vot_rectangle_copy(region);
+}
+
+#define _trax_to_region _trax_to_rectangle
+#define _region_to_trax _rectangle_to_trax
+
+#endif
+#if _VOT_REGION == 2
+
+typedef vot_polygon vot_region;
+
+VOT_INLINE void vot_region_release(vot_region** region) {
+    vot_polygon_release(region);
+}
+
+VOT_INLINE vot_region* vot_region_create(int n) {
+    return vot_polygon_create(n);
+}
+
+VOT_INLINE vot_region* vot_region_copy(const vot_region* region) {
+    return vot_polygon_copy(region);
+}
+
+#define _trax_to_region _trax_to_polygon
+#define _region_to_trax _polygon_to_trax
+
+#endif
+#if _VOT_REGION == 3
+
+typedef vot_mask vot_region;
+
+VOT_INLINE void vot_region_release(vot_region** region) {
+    vot_mask_release(region);
+}
+
+VOT_INLINE vot_region* vot_region_create(int width, int height) {
+    return vot_mask_create(width, height);
+}
+
+VOT_INLINE vot_region* vot_region_copy(const vot_region* region) {
+    return vot_mask_copy(region);
+}
+
+#define _trax_to_region _trax_to_mask
+#define _region_to_trax _mask_to_trax
 
 #endif
 
 typedef vot_region** vot_objects;
 
 #ifdef __cplusplus
+#  define VOT_WRAPPER "cpp"
+#else
+#  define VOT_WRAPPER "c"
+#endif
+
+/**
+ * Session log, a compact binary record of a TraX session: the requests sent
+ * by the client (images, objects and properties) and the replies of the
+ * tracker with their time. Logs are written by the wrapper if the VOT_RECORD
+ * environment variable names a file. If VOT_REPLAY names a log the wrapper
+ * does not connect to a client, it reads the requests from the log instead
+ * and the tracker runs as fast as it can (see vot_replay.cpp).
+ */
+typedef struct vot_log {
+    FILE* file;
+    int write;
+    int channels;
+    int flags;
+} vot_log;
+
+VOT_API vot_log* vot_log_open(const char* filename, int write, int channels, int flags);
+VOT_API void vot_log_close(vot_log** log);
+VOT_API void vot_log_write(vot_log* log, int type, const trax_image_list* images, trax_object_list* objects, const trax_properties* properties, double time);
+VOT_API int vot_log_read(vot_log* log, trax_image_list** images, trax_object_list** objects, trax_properties* properties, double* time);
+
+VOT_API trax_handle* _vot_server_setup(int region_formats, int image_formats, int channels, int flags);
+VOT_API int _vot_server_wait(trax_handle* handle, trax_image_list** images, trax_object_list** objects, trax_properties* properties);
+VOT_API int _vot_server_reply(trax_handle* handle, trax_object_list* objects);
+VOT_API void _vot_server_cleanup(trax_handle** handle);
+
+#ifndef __cplusplus
+
+#ifdef VOT_MULTI_OBJECT
+VOT_API vot_objects vot_initialize();
+VOT_API vot_objects vot_reset();
+VOT_API void vot_report(vot_objects objects);
+#else
+VOT_API vot_region* vot_initialize();
+VOT_API vot_region* vot_reset();
+VOT_API void vot_report(vot_region* region);
+VOT_API void vot_report2(vot_region* region, float confidence);
+#endif
+VOT_API void vot_quit();
+VOT_API const vot_image* vot_frame();
+VOT_API int vot_end();
+
+#else
 
 #include <string>
+#include <vector>
+#include <variant>
 #include <fstream>
 #include <iostream>
 #include <type_traits>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <typeinfo>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+#ifdef VOT_OPENCV
+#include <future>
+#include <functional>
+#include <memory>
+#include <map>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+// Partial decoding for a region of interest, VOT_LIBJPEG requires libjpeg-turbo 1.5 or later
+#if defined(VOT_LIBJPEG) || defined(VOT_LIBPNG)
+#include <setjmp.h>
+#endif
+#ifdef VOT_LIBJPEG
+#include <jpeglib.h>
+#endif
+#ifdef VOT_LIBPNG
+#include <png.h>
+#endif
+#endif
 
 using namespace std;
 
 class VOT;
 
+/**
+ * Images of a single frame, one for each channel. Channels that were not
+ * requested from the client are left empty. Images that the client sent in
+ * memory or as encoded buffers have no path, they are available in data
+ * (indexed by TraX channel index) until the next frame is requested.
+ */
 typedef struct VOTImage {
-#ifdef VOT_RGBD
     string color;
     string depth;
-#elif defined(VOT_IR)
-    string ir;
-#elif defined(VOT_RGBT)
-    string color;
     string ir;
-#else
-    string color;
-#endif
+    const trax_image* data[TRAX_CHANNELS] = {NULL, NULL, NULL};
 } VOTImage;
 
-class VOTRegion {
-    friend class VOT;
+/**
+ * Region formats supported by the wrapper. The numbering follows the
+ * _VOT_REGION values used by the C API.
+ */
+enum class VOTFormat {
+    Rectangle = 1,
+    Polygon = 2,
+    Mask = 3
+};
+
+/**
+ * Compile-time description of a region format: the underlying C structure,
+ * the matching TraX region type and functions for memory management and
+ * conversion to and from TraX regions.
+ */
+template <VOTFormat F>
+struct VOTFormatTraits;
+
+template <>
+struct VOTFormatTraits<VOTFormat::Rectangle> {
+    typedef vot_rectangle type;
+    static constexpr int trax = TRAX_REGION_RECTANGLE;
+    static constexpr const char* name = "rectangle";
+
+    static type* copy(const type* region) { return vot_rectangle_copy(region); }
+    static void release(type** region) { vot_rectangle_release(region); }
+    static type* from_trax(const trax_region* region) { return _trax_to_rectangle(region); }
+    static trax_region* to_trax(const type* region) { return _rectangle_to_trax(region); }
+
+    static void assign(type** destination, const type* source) {
+        **destination = *source;
+    }
+};
+
+template <>
+struct VOTFormatTraits<VOTFormat::Polygon> {
+    typedef vot_polygon type;
+    static constexpr int trax = TRAX_REGION_POLYGON;
+    static constexpr const char* name = "polygon";
+
+    static type* copy(const type* region) { return vot_polygon_copy(region); }
+    static void release(type** region) { vot_polygon_release(region); }
+    static type* from_trax(const trax_region* region) { return _trax_to_polygon(region); }
+    static trax_region* to_trax(const type* region) { return _polygon_to_trax(region); }
+
+    static void assign(type** destination, const type* source) {
+        if ((*destination)->count != source->count) {
+            vot_polygon_release(destination);
+            *destination = vot_polygon_create(source->count);
+        }
+        memcpy((*destination)->x, source->x, sizeof(float) * source->count);
+        memcpy((*destination)->y, source->y, sizeof(float) * source->count);
+    }
+};
+
+template <>
+struct VOTFormatTraits<VOTFormat::Mask> {
+    typedef vot_mask type;
+    static constexpr int trax = TRAX_REGION_MASK;
+    static constexpr const char* name = "mask";
+
+    static type* copy(const type* region) { return vot_mask_copy(region); }
+    static void release(type** region) { vot_mask_release(region); }
+    static type* from_trax(const trax_region* region) { return _trax_to_mask(region); }
+    static trax_region* to_trax(const type* region) { return _mask_to_trax(region); }
+
+    static void assign(type** destination, const type* source) {
+        if ((*destination)->width != source->width || (*destination)->height != source->height) {
+            vot_mask_release(destination);
+            *destination = vot_mask_create(source->width, source->height);
+        }
+        memcpy((*destination)->data, source->data, source->width * source->height);
+    }
+};
+
+// Region format selected with VOT_RECTANGLE, VOT_POLYGON or VOT_MASK
+constexpr VOTFormat VOT_DEFAULT_FORMAT = static_cast<VOTFormat>(_VOT_REGION);
+
+template <VOTFormat F>
+class VOTRegionOf;
+
+/**
+ * Owning wrapper around a C region structure, shared by all region formats.
+ * Format specific accessors are provided by VOTRegionOf specializations.
+ */
+template <VOTFormat F>
+class VOTRegionBase {
 public:
 
-    ~VOTRegion() {
-        vot_region_release(&_region);
+    typedef VOTFormatTraits<F> traits;
+    typedef typename traits::type raw_type;
+
+    static constexpr VOTFormat format = F;
+
+    ~VOTRegionBase() {
+        traits::release(&_region);
     }
 
-    VOTRegion(const vot_region* region) {
-        _region = vot_region_copy(region);
+    VOTRegionBase(const raw_type* region) {
+        _region = traits::copy(region);
     }
 
-    VOTRegion(const VOTRegion& region) {
-        _region = vot_region_copy(region._region);
+    VOTRegionBase(const VOTRegionBase& region) {
+        _region = traits::copy(region._region);
     }
 
-    VOTRegion(VOTRegion&& region) {
+    VOTRegionBase(VOTRegionBase&& region) {
         _region = region._region;
         region._region = NULL;
     }
 
-    VOTRegion& operator= (VOTRegion&& region) {
-        vot_region_release(&_region);
+    VOTRegionBase& operator= (VOTRegionBase&& region) {
+        traits::release(&_region);
         _region = region._region;
         region._region = NULL;
         return *this;
     }
 
-#if _VOT_REGION == 1
-
-    VOTRegion() {
-        _region = vot_region_create();
-    }
-
-    float get_x() const { return _region->x; }
-    float get_y() const { return _region->y; }
-    float get_width() const { return _region->width; }
-    float get_height() const { return _region->height; }
+    VOTRegionBase& operator= (const VOTRegionBase& source) {
 
-    float set_x(float x) { return _region->x = x; }
-    float set_y(float y) { return _region->y = y; }
-    float set_width(float width) { return _region->width = width; }
-    float set_height(float height) { return _region->height = height; }
+        if (this == &source)
+            return *this;
 
-#endif
-#if _VOT_REGION == 2
-    VOTRegion(int count) {
-        _region = vot_region_create(count);
-    }
+        if (_region)
+            traits::assign(&_region, source._region);
+        else
+            _region = traits::copy(source._region);
 
-    void set(int i, float x, float y) { assert(i >= 0 && i < _region->count); _region->x[i] = x; _region->y[i] = y; }
-    float get_x(int i) const { assert(i >= 0 && i < _region->count); return _region->x[i]; }
-    float get_y(int i) const { assert(i >= 0 && i < _region->count); return _region->y[i]; }
-    int count() const { return _region->count; }
-#endif
-#if _VOT_REGION == 3
-    VOTRegion(int width, int height) {
-        _region = vot_region_create(width, height);
+        return *this;
     }
 
-    int width() const { return _region->width; }
-    int height() const { return _region->height; }
-    char get(int x, int y) const { return _region->data[x + y * _region->width]; }
-    void set(int x, int y, char val) { _region->data[x + y * _region->width] = val; }
+    const raw_type* raw() const { return _region; }
 
-#endif
+    trax_region* to_trax() const { return traits::to_trax(_region); }
 
+    /**
+     * Converts a TraX region to this format. Regions in the same format are
+     * converted directly, other formats are first converted by TraX.
+     */
+    static VOTRegionOf<F> from_trax(const trax_region* region) {
 
-    VOTRegion& operator= (const VOTRegion &source) {
+        if (trax_region_get_type(region) == traits::trax)
+            return VOTRegionOf<F>(traits::from_trax(region), adopt());
 
-        if (this == &source)
-            return *this;
+        trax_region* converted = trax_region_convert(region, traits::trax);
+        VOTRegionOf<F> result(traits::from_trax(converted), adopt());
+        trax_region_release(&converted);
+        return result;
+    }
 
-#if _VOT_REGION == 1
+protected:
 
-        set_x(source.get_x());
-        set_y(source.get_y());
-        set_width(source.get_width());
-        set_height(source.get_height());
+    struct adopt {};
 
-#endif
-#if _VOT_REGION == 2
+    VOTRegionBase(raw_type* region, adopt) {
+        _region = region;
+    }
 
-        if (this->_region->count != source.count()) {
-            vot_region_release(&(this->_region));
-            this->_region = vot_region_create(source.count());
-        }
+    raw_type* _region;
 
-        for (int i = 0; i < source.count(); i++) {
-            set(i, source.get_x(i), source.get_y(i));
-        }
+};
 
-#endif
-#if _VOT_REGION == 3
+template <>
+class VOTRegionOf<VOTFormat::Rectangle> : public VOTRegionBase<VOTFormat::Rectangle> {
+public:
 
-        if (this->_region->width != source.width() || this->_region->height != source.height()) {
-            vot_region_release(&(this->_region));
-            this->_region = vot_region_create(source.width(), source.height());
-        }
+    using VOTRegionBase::VOTRegionBase;
 
-        memcpy(this->_region->data, source._region->data, this->_region->height * this->_region->width);
+    VOTRegionOf() : VOTRegionBase(vot_rectangle_create(), adopt()) { }
 
-#endif
+    float get_x() const { return _region->x; }
+    float get_y() const { return _region->y; }
+    float get_width() const { return _region->width; }
+    float get_height() const { return _region->height; }
 
-        return *this;
-    }
+    float set_x(float x) { return _region->x = x; }
+    float set_y(float y) { return _region->y = y; }
+    float set_width(float width) { return _region->width = width; }
+    float set_height(float height) { return _region->height = height; }
 
 #ifdef VOT_OPENCV
-#if _VOT_REGION == 1
 
-    VOTRegion(const cv::Rect& rectangle) {
-        _region = vot_region_create();
+    VOTRegionOf(const cv::Rect& rectangle) : VOTRegionBase(vot_rectangle_create(), adopt()) {
         set(rectangle);
     }
 
@@ -367,39 +672,54 @@ public:
     }
 
 #endif
-#if _VOT_REGION == 2
 
-    VOTRegion(const cv::Rect& rectangle) {
-        _region = vot_region_create(4);
+};
+
+template <>
+class VOTRegionOf<VOTFormat::Polygon> : public VOTRegionBase<VOTFormat::Polygon> {
+public:
+
+    using VOTRegionBase::VOTRegionBase;
+
+    VOTRegionOf(int count) : VOTRegionBase(vot_polygon_create(count), adopt()) { }
+
+    void set(int i, float x, float y) { assert(i >= 0 && i < _region->count); _region->x[i] = x; _region->y[i] = y; }
+    float get_x(int i) const { assert(i >= 0 && i < _region->count); return _region->x[i]; }
+    float get_y(int i) const { assert(i >= 0 && i < _region->count); return _region->y[i]; }
+    int count() const { return _region->count; }
+
+#ifdef VOT_OPENCV
+
+    VOTRegionOf(const cv::Rect& rectangle) : VOTRegionBase(vot_polygon_create(4), adopt()) {
         set(rectangle);
     }
 
     void set(const cv::Rect& rectangle) {
 
         if (_region->count != 4) {
-            vot_region_release(&(this->_region));
-            _region = vot_region_create(4);
+            vot_polygon_release(&(this->_region));
+            _region = vot_polygon_create(4);
         }
 
-	    set(0, rectangle.x, rectangle.y);
-	    set(1, rectangle.x + rectangle.width, rectangle.y);
-	    set(2, rectangle.x + rectangle.width, rectangle.y + rectangle.height);
-	    set(3, rectangle.x, rectangle.y + rectangle.height);
+        set(0, rectangle.x, rectangle.y);
+        set(1, rectangle.x + rectangle.width, rectangle.y);
+        set(2, rectangle.x + rectangle.width, rectangle.y + rectangle.height);
+        set(3, rectangle.x, rectangle.y + rectangle.height);
     }
 
     void get(cv::Rect& rectangle) const {
 
-	    float top = FLT_MAX;
-	    float bottom = FLT_MIN;
-	    float left = FLT_MAX;
-	    float right = FLT_MIN;
+        float top = FLT_MAX;
+        float bottom = -FLT_MAX;
+        float left = FLT_MAX;
+        float right = -FLT_MAX;
 
-	    for (int j = 0; j < _region->count; j++) {
-		    top = MIN(top, _region->y[j]);
-		    bottom = MAX(bottom, _region->y[j]);
-		    left = MIN(left, _region->x[j]);
-		    right = MAX(right, _region->x[j]);
-	    }
+        for (int j = 0; j < _region->count; j++) {
+            top = MIN(top, _region->y[j]);
+            bottom = MAX(bottom, _region->y[j]);
+            left = MIN(left, _region->x[j]);
+            right = MAX(right, _region->x[j]);
+        }
 
         rectangle.x = left;
         rectangle.y = top;
@@ -412,364 +732,3785 @@ public:
         this->get(rectangle);
     }
 
+#endif
+
+};
+
+template <>
+class VOTRegionOf<VOTFormat::Mask> : public VOTRegionBase<VOTFormat::Mask> {
+public:
+
+    using VOTRegionBase::VOTRegionBase;
+
+    VOTRegionOf(int width, int height) : VOTRegionBase(vot_mask_create(width, height), adopt()) { }
+
+    int width() const { return _region->width; }
+    int height() const { return _region->height; }
+    char get(int x, int y) const { return _region->data[x + y * _region->width]; }
+    void set(int x, int y, char val) { _region->data[x + y * _region->width] = val; }
+
+#ifdef VOT_OPENCV
+
+    VOTRegionOf(const cv::Mat& mask) : VOTRegionBase(vot_mask_create(mask.cols, mask.rows), adopt()) {
+        set(mask);
+    }
+
+    void set(const cv::Mat& mask) {
+
+        assert(!mask.empty() && mask.channels() == 1 && mask.elemSize() == 1);
+
+        if (_region->width != mask.cols || _region->height != mask.rows) {
+            vot_mask_release(&(this->_region));
+            _region = vot_mask_create(mask.cols, mask.rows);
+        }
+
+        for (int i = 0; i < mask.rows; i++) {
+            memcpy(&(_region->data[mask.cols * i]), mask.ptr(i), _region->width * sizeof(char));
+        }
+
+    }
+
+    void get(cv::Mat& mask) const {
+
+        mask.create(cv::Size(_region->width, _region->height), CV_8UC1);
+
+        memcpy(mask.ptr(0), _region->data, _region->height * _region->width * sizeof(char));
+
+    }
+
+    void get(cv::Rect& rectangle) const {
+
+        int left = _region->width, top = _region->height, right = -1, bottom = -1;
+
+        for (int y = 0; y < _region->height; y++) {
+            const char* row = &(_region->data[y * _region->width]);
+            for (int x = 0; x < _region->width; x++) {
+                if (!row[x]) continue;
+                left = MIN(left, x);
+                right = MAX(right, x);
+                top = MIN(top, y);
+                bottom = MAX(bottom, y);
+            }
+        }
+
+        if (right < left) {
+            rectangle = cv::Rect();
+            return;
+        }
+
+        rectangle = cv::Rect(left, top, right - left + 1, bottom - top + 1);
+
+    }
+
+    void operator= (cv::Mat& mask) {
+        this->get(mask);
+    }
+
+#endif
+
+};
+
+// Region type used by trackers that select the format at compile time
+typedef VOTRegionOf<VOT_DEFAULT_FORMAT> VOTRegion;
+
+// Region type used by trackers that accept any format negotiated at runtime
+typedef std::variant<VOTRegionOf<VOTFormat::Rectangle>, VOTRegionOf<VOTFormat::Polygon>, VOTRegionOf<VOTFormat::Mask>> VOTAnyRegion;
+
+template <class R>
+struct vot_is_region : std::false_type { };
+
+template <VOTFormat F>
+struct vot_is_region<VOTRegionOf<F>> : std::true_type { };
+
+template <>
+struct vot_is_region<VOTAnyRegion> : std::true_type { };
+
+inline VOTFormat vot_format(const VOTAnyRegion& region) {
+    return static_cast<VOTFormat>(region.index() + 1);
+}
+
+/**
+ * Converts a TraX region to a runtime typed region, keeping its format.
+ * Special regions are converted to rectangles.
+ */
+inline VOTAnyRegion vot_region_from_trax(const trax_region* region) {
+
+    switch (trax_region_get_type(region)) {
+    case TRAX_REGION_POLYGON:
+        return VOTRegionOf<VOTFormat::Polygon>::from_trax(region);
+    case TRAX_REGION_MASK:
+        return VOTRegionOf<VOTFormat::Mask>::from_trax(region);
+    default:
+        return VOTRegionOf<VOTFormat::Rectangle>::from_trax(region);
+    }
+
+}
+
+template <VOTFormat F>
+inline trax_region* vot_region_to_trax(const VOTRegionOf<F>& region) {
+    return region.to_trax();
+}
+
+inline trax_region* vot_region_to_trax(const VOTAnyRegion& region) {
+    return std::visit([](const auto& typed) { return typed.to_trax(); }, region);
+}
+
+#ifdef VOT_OPENCV
+
+template <VOTFormat F>
+void operator<< (VOTRegionOf<F> &source, const cv::Rect& rectangle) {
+    source.set(rectangle);
+}
+
+template <VOTFormat F>
+void operator>> (const VOTRegionOf<F> &source, cv::Rect& rectangle) {
+    source.get(rectangle);
+}
+
+template <VOTFormat F>
+void operator<< (cv::Rect& rectangle, const VOTRegionOf<F> &source) {
+    source.get(rectangle);
+}
+
+template <VOTFormat F>
+void operator>> (const cv::Rect& rectangle, VOTRegionOf<F> &source) {
+    source.set(rectangle);
+}
+
+inline void operator<< (VOTRegionOf<VOTFormat::Mask> &source, const cv::Mat& mask) {
+    source.set(mask);
+}
+
+inline void operator>> (const VOTRegionOf<VOTFormat::Mask> &source, cv::Mat& mask) {
+    source.get(mask);
+}
+
+inline void operator<< (cv::Mat& mask, const VOTRegionOf<VOTFormat::Mask> &source) {
+    source.get(mask);
+}
+
+inline void operator>> (const cv::Mat& mask, VOTRegionOf<VOTFormat::Mask> &source) {
+    source.set(mask);
+}
+
+#endif
+
+/**
+ * Thread that converts reported objects and sends them to the client for a
+ * VOT handle with asynchronous replies. Replies are sent in the order they
+ * were submitted, flush() waits until all of them were sent.
+ */
+class VOTReplier {
+
+public:
+
+    VOTReplier() { }
+
+    VOTReplier(const VOTReplier&) = delete;
+
+    VOTReplier& operator=(const VOTReplier&) = delete;
+
+    ~VOTReplier() {
+        stop();
+    }
+
+    /**
+     * Queues a reply, objects returns the list of objects that is sent and
+     * released by the thread. The thread is started with the first reply.
+     */
+    void submit(trax_handle* handle, std::function<trax_object_list*()> objects) {
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        if (!_thread.joinable()) {
+            _stop = false;
+            _thread = std::thread(&VOTReplier::loop, this);
+        }
+
+        _replies.push_back(Reply{handle, std::move(objects)});
+        _wake.notify_one();
+
+    }
+
+    void flush() {
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _done.wait(lock, [this]() { return _replies.empty() && !_busy; });
+
+    }
+
+    // Sends the remaining replies and stops the thread
+    void stop() {
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+            _wake.notify_one();
+        }
+
+        if (_thread.joinable())
+            _thread.join();
+
+    }
+
+private:
+
+    struct Reply {
+        trax_handle* handle;
+        std::function<trax_object_list*()> objects;
+    };
+
+    void loop() {
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (true) {
+
+            _wake.wait(lock, [this]() { return _stop || !_replies.empty(); });
+
+            if (_replies.empty())
+                return;
+
+            Reply reply = std::move(_replies.front());
+            _replies.pop_front();
+            _busy = true;
+
+            lock.unlock();
+
+            trax_object_list* objects = reply.objects();
+            _vot_server_reply(reply.handle, objects);
+            trax_object_list_release(&objects);
+
+            lock.lock();
+
+            _busy = false;
+            _done.notify_all();
+
+        }
+
+    }
+
+    std::thread _thread;
+
+    std::mutex _mutex;
+
+    std::condition_variable _wake;
+
+    std::condition_variable _done;
+
+    std::deque<Reply> _replies;
+
+    bool _busy = false;
+
+    bool _stop = false;
+
+};
+
+class VOT {
+public:
+
+    /**
+     * Sets up the connection. The formats argument is a combination of
+     * TRAX_REGION_* flags that the tracker accepts, by default only the
+     * format selected at compile time is accepted. Channels and flags
+     * default to the ones selected with VOT_RGBD, VOT_RGBT, VOT_IR and
+     * VOT_MULTI_OBJECT. Images are a combination of TRAX_IMAGE_* flags,
+     * trackers that accept TRAX_IMAGE_MEMORY or TRAX_IMAGE_BUFFER read
+     * the images from VOTImage::data, paths are always accepted. The
+     * constructor blocks until the client sends the first frame, setup that
+     * does not depend on it can run meanwhile in a VOTStartup.
+     */
+    VOT(int formats = VOTFormatTraits<VOT_DEFAULT_FORMAT>::trax, int channels = _VOT_CHANNELS, int flags = _VOT_FLAGS, int images = TRAX_IMAGE_PATH) {
+        vot_initialize(formats, channels, flags, images);
+    }
+
+    ~VOT() {
+        vot_quit();
+    }
+
+    /**
+     * Returns the format of the initialization regions, as chosen by the client.
+     */
+    VOTFormat format() const {
+        return _format;
+    }
+
+    template <VOTFormat F = VOT_DEFAULT_FORMAT>
+    const std::vector<VOTRegionOf<F>> objects() {
+
+        std::vector<VOTRegionOf<F>> wrappers;
+
+        for (int i = 0; i < trax_object_list_count(_objects); i++) {
+            wrappers.push_back(VOTRegionOf<F>::from_trax(trax_object_list_get(_objects, i)));
+        }
+
+        return wrappers;
+    }
+
+    const std::vector<VOTAnyRegion> objects_any() {
+
+        std::vector<VOTAnyRegion> wrappers;
+
+        for (int i = 0; i < trax_object_list_count(_objects); i++) {
+            wrappers.push_back(vot_region_from_trax(trax_object_list_get(_objects, i)));
+        }
+
+        return wrappers;
+    }
+
+    template <VOTFormat F = VOT_DEFAULT_FORMAT>
+    const VOTRegionOf<F> region() {
+        assert(trax_object_list_count(_objects) > 0);
+        return VOTRegionOf<F>::from_trax(trax_object_list_get(_objects, 0));
+    }
+
+    const VOTAnyRegion region_any() {
+        assert(trax_object_list_count(_objects) > 0);
+        return vot_region_from_trax(trax_object_list_get(_objects, 0));
+    }
+
+    template <class R, typename std::enable_if<vot_is_region<R>::value, int>::type = 0>
+    void report(const std::vector<R>& objects) {
+
+        if (_async_reply) {
+            vot_submit([objects]() { return vot_objects_to_trax(objects); });
+            return;
+        }
+
+        vot_report(vot_objects_to_trax(objects));
+    }
+
+    /**
+     * Reports objects that are no longer needed, with asynchronous replies
+     * they are moved to the reply thread instead of copied.
+     */
+    template <class R, typename std::enable_if<vot_is_region<R>::value, int>::type = 0>
+    void report(std::vector<R>&& objects) {
+
+        if (_async_reply) {
+            vot_submit([objects = std::move(objects)]() { return vot_objects_to_trax(objects); });
+            return;
+        }
+
+        vot_report(vot_objects_to_trax(objects));
+    }
+
+    void report(const VOTRegion& region, float confidence = 1) {
+        report<VOTRegion>(region, confidence);
+    }
+
+    template <class R, typename std::enable_if<vot_is_region<R>::value, int>::type = 0>
+    void report(const R& region, float confidence = 1) {
+
+        if (_async_reply) {
+            vot_submit([region, confidence]() { return vot_object_to_trax(region, confidence); });
+            return;
+        }
+
+        vot_report(vot_object_to_trax(region, confidence));
+    }
+
+    /**
+     * Enables asynchronous replies. Reported objects are then converted to
+     * TraX regions, encoded and sent to the client by a dedicated thread
+     * (VOTReplier), so the tracker can continue with work that does not
+     * need the next frame while large masks are sent. The client sends the
+     * next frame only after the reply, the wrapper waits for the reply
+     * before it reads the next request, so the order of messages does not
+     * change. Disabled by default.
+     */
+    void async_reply(bool async = true) {
+        if (!async)
+            _replier.flush();
+        _async_reply = async;
+    }
+
+#if defined(VOT_RGBD) || defined(VOT_RGBT)
+    const VOTImage& frame() {
+        return image();
+    }
+#elif defined(VOT_IR)
+    const string& frame() {
+        return image().ir;
+    }
+#else
+    const string& frame() {
+        return image().color;
+    }
+#endif
+
+    /**
+     * Waits for the next frame. The returned image is owned by the handle and
+     * is valid until the next frame is requested, it is empty if the sequence
+     * is over.
+     */
+    const VOTImage& image() {
+
+        vot_frame();
+
+        return _image;
+    }
+
+    bool end() {
+        return _trax_handle == NULL;
+    }
+
+    /**
+     * Enables handling of reinitialization requests. The client may send new
+     * objects instead of a frame, such frame is returned by image() as usual,
+     * reset() is then true and objects() returns the new objects. The tracker
+     * reinitializes on this frame and does not report for it. If handling is
+     * disabled (the default unless VOT_REINITIALIZE is defined) the wrapper
+     * quits on a reinitialization request.
+     */
+    void accept_reset(bool accept = true) {
+        _accept_reset = accept;
+    }
+
+    /**
+     * True if the current frame reinitializes the tracker.
+     */
+    bool reset() const {
+        return _reset;
+    }
+
+    /**
+     * Enables objects that start on a later frame. The client may send new
+     * objects with a frame, they are returned by added() for that frame and
+     * are reported after the existing ones, starting with this frame. The
+     * client can also list indices of objects that have finished in the
+     * "retired" property of a frame (comma separated), they are returned by
+     * retired(). If disabled (the default) objects with a frame are an error.
+     */
+    void accept_objects(bool accept = true) {
+        _accept_objects = accept;
+    }
+
+    /**
+     * Objects that start on the current frame.
+     */
+    template <VOTFormat F = VOT_DEFAULT_FORMAT>
+    const std::vector<VOTRegionOf<F>> added() {
+
+        std::vector<VOTRegionOf<F>> wrappers;
+
+        for (int i = 0; _added && i < trax_object_list_count(_added); i++) {
+            wrappers.push_back(VOTRegionOf<F>::from_trax(trax_object_list_get(_added, i)));
+        }
+
+        return wrappers;
+    }
+
+    /**
+     * Indices of objects that finished before the current frame.
+     */
+    const std::vector<int>& retired() const {
+        return _retired;
+    }
+
+private:
+
+    VOT_API void vot_initialize(int formats, int channels, int flags, int images);
+
+    VOT_API void vot_quit();
+
+    /**
+     * Waits for the next frame and stores its image paths. Returns false
+     * if the sequence is over.
+     */
+    bool vot_frame() {
+
+        if (!_trax_handle)
+            return false;
+
+        // The handle is used by one thread at a time, the reply to the previous frame is sent first
+        _replier.flush();
+
+        trax_image_list* _trax_image = NULL;
+        trax_object_list* _trax_objects = NULL;
+
+        if (_vot_sequence_position == 0) {
+            _vot_sequence_position++;
+            return true;
+        }
+
+        trax_properties* _trax_properties = _accept_objects ? trax_properties_create() : NULL;
+
+        int response = _vot_server_wait(_trax_handle, &_trax_image, &_trax_objects, _trax_properties);
+
+        _reset = false;
+
+        if (_added)
+            trax_object_list_release(&_added);
+
+        _retired.clear();
+
+        if (_trax_properties) {
+            vot_read_retired(_trax_properties);
+            trax_properties_release(&_trax_properties);
+        }
+
+        if (response == TRAX_INITIALIZE && _accept_reset) {
+            vot_accept(_trax_image, _trax_objects);
+            _reset = true;
+            return true;
+        }
+
+        if (response == TRAX_FRAME && _accept_objects && _trax_objects && trax_object_list_count(_trax_objects) > 0) {
+            _added = _trax_objects;
+            _trax_objects = NULL;
+        }
+
+        // Objects can only be given with a frame as a reinitialization or if new objects are accepted
+        assert(response != TRAX_FRAME || _trax_objects == NULL || trax_object_list_count(_trax_objects) == 0);
+
+        trax_object_list_release(&_trax_objects);
+
+        if (response != TRAX_FRAME) {
+            if (_trax_image) {
+                trax_image_list_clear(_trax_image);
+                trax_image_list_release(&_trax_image);
+            }
+            vot_quit();
+            return false;
+        }
+
+        vot_read_image(_trax_image);
+
+        return true;
+
+    }
+
+    /**
+     * Parses the indices of retired objects from frame properties.
+     */
+    void vot_read_retired(const trax_properties* properties) {
+
+        char* value = trax_properties_get(properties, "retired");
+
+        if (!value)
+            return;
+
+        const char* position = value;
+
+        while (*position) {
+            char* end;
+            long index = strtol(position, &end, 10);
+            if (end == position) {
+                position++;
+                continue;
+            }
+            _retired.push_back((int) index);
+            position = end;
+        }
+
+        free(value);
+
+    }
+
+    /**
+     * Accepts an initialization request: the objects are confirmed to the
+     * client and replace the current ones, the handle takes ownership of the
+     * images and objects.
+     */
+    void vot_accept(trax_image_list* _trax_image, trax_object_list* _trax_objects) {
+
+        vot_read_image(_trax_image);
+
+        _vot_server_reply(_trax_handle, _trax_objects);
+
+        if (_objects)
+            trax_object_list_release(&_objects);
+
+        _objects = _trax_objects;
+
+        if (_objects && trax_object_list_count(_objects) > 0) {
+            switch (trax_region_get_type(trax_object_list_get(_objects, 0))) {
+            case TRAX_REGION_POLYGON: _format = VOTFormat::Polygon; break;
+            case TRAX_REGION_MASK: _format = VOTFormat::Mask; break;
+            default: _format = VOTFormat::Rectangle;
+            }
+        }
+
+    }
+
+    /**
+     * Takes ownership of the images of a new frame, the images of the
+     * previous frame are released. Paths are copied into the storage of the
+     * previous frame, so no memory is allocated once paths stop growing.
+     */
+    void vot_read_image(trax_image_list* _trax_image) {
+
+        vot_release_image();
+
+        _images = _trax_image;
+
+        std::string* paths[TRAX_CHANNELS] = {&_image.color, &_image.depth, &_image.ir};
+
+        for (int i = 0; i < TRAX_CHANNELS; i++) {
+            trax_image* channel = (_channels & TRAX_CHANNEL_ID(i)) ? trax_image_list_get(_trax_image, TRAX_CHANNEL_ID(i)) : NULL;
+            if (channel && trax_image_get_type(channel) == TRAX_IMAGE_PATH)
+                paths[i]->assign(trax_image_get_path(channel));
+            else if (channel)
+                _image.data[i] = channel;
+        }
+
+    }
+
+    void vot_release_image() {
+
+        if (_images) {
+            trax_image_list_clear(_images);
+            trax_image_list_release(&_images);
+        }
+
+        _image.color.clear();
+        _image.depth.clear();
+        _image.ir.clear();
+
+        for (int i = 0; i < TRAX_CHANNELS; i++)
+            _image.data[i] = NULL;
+
+    }
+
+    /**
+     * Sends the list of reported objects to the client and releases it.
+     */
+    void vot_report(trax_object_list* objects) {
+
+        assert (_trax_handle);
+
+        _vot_server_reply(_trax_handle, objects);
+        trax_object_list_release(&objects);
+
+    }
+
+    /**
+     * Queues a reply for the reply thread, the handle is checked here as in
+     * vot_report so that a report after the end fails at the call site.
+     */
+    void vot_submit(std::function<trax_object_list*()> objects) {
+
+        assert (_trax_handle);
+
+        _replier.submit(_trax_handle, std::move(objects));
+
+    }
+
+    template <class R>
+    static trax_object_list* vot_objects_to_trax(const std::vector<R>& objects) {
+
+        trax_object_list* _list = trax_object_list_create(objects.size());
+
+        for (size_t i = 0; i < objects.size(); i++) {
+            trax_region* _trax_region = vot_region_to_trax(objects[i]);
+            trax_object_list_set(_list, i, _trax_region);
+            trax_region_release(&_trax_region);
+        }
+
+        return _list;
+    }
+
+    template <class R>
+    static trax_object_list* vot_object_to_trax(const R& region, float confidence) {
+
+        trax_object_list* _list = trax_object_list_create(1);
+        trax_region* _trax_region = vot_region_to_trax(region);
+        trax_object_list_set(_list, 0, _trax_region);
+        trax_properties_set_float(trax_object_list_properties(_list, 0), "confidence", confidence);
+        trax_region_release(&_trax_region);
+
+        return _list;
+    }
+
+    // Current position in the sequence
+    int _vot_sequence_position = 0;
+
+    trax_handle* _trax_handle = NULL;
+
+    bool _accept_reset = _VOT_REINITIALIZE;
+
+    bool _reset = false;
+
+    bool _accept_objects = false;
+
+    // Objects that start on the current frame and indices of retired objects
+    trax_object_list* _added = NULL;
+
+    std::vector<int> _retired;
+
+    int _channels = 0;
+
+    // Images of the current frame, path storage is reused between frames
+    VOTImage _image;
+
+    // Images of the current frame, kept so that images sent in memory can be used without a copy
+    trax_image_list* _images = NULL;
+
+    // Initialization objects in the format sent by the client
+    trax_object_list* _objects = NULL;
+
+    VOTFormat _format = VOT_DEFAULT_FORMAT;
+
+    bool _async_reply = false;
+
+    VOTReplier _replier;
+
+};
+
+#ifdef VOT_OPENCV
+
+/**
+ * Decoded images of a single frame. Depth is either raw (CV_16UC1, as stored
+ * in the sequence) or metric (CV_32FC1). Channels that were not decoded are
+ * empty. If the loader has a region of interest, color is cropped to it and
+ * offset is the position of the crop in the full color image of the given
+ * size, otherwise the offset is zero and the size is the size of color.
+ */
+typedef struct VOTFrame {
+    cv::Mat color;
+    cv::Mat depth;
+    cv::Mat ir;
+    cv::Point offset;
+    cv::Size size;
+} VOTFrame;
+
+#ifndef _WIN32
+
+/**
+ * On-disk cache of decoded images, keyed by the image path, its modification
+ * time and the decode flags. Images are stored uncompressed, one file per
+ * image, and are memory-mapped when loaded, so repeated runs over the same
+ * sequence read them from the page cache instead of decoding them again.
+ * Entries are written atomically, so several tracker processes can share
+ * one cache directory. The cache is never pruned.
+ */
+class VOTFrameCache {
+public:
+
+    VOTFrameCache(const std::string& directory) : _directory(directory) {
+        mkdir(directory.c_str(), 0777);
+    }
+
+    /**
+     * Maps the cached image into the matrix. The mapping is private, pages
+     * are copied only if the image is modified. Returns a handle that keeps
+     * the mapping alive or an empty pointer if the image is not in the cache.
+     */
+    std::shared_ptr<void> load(const std::string& path, int flags, cv::Mat& image) const {
+
+        struct stat source, entry;
+
+        if (stat(path.c_str(), &source) != 0)
+            return std::shared_ptr<void>();
+
+        std::string filename = entry_path(path, flags, source);
+
+        int fd = open(filename.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            return std::shared_ptr<void>();
+
+        void* data = MAP_FAILED;
+
+        if (fstat(fd, &entry) == 0 && entry.st_size >= (off_t) sizeof(Header))
+            data = mmap(NULL, entry.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+        close(fd);
+
+        if (data == MAP_FAILED)
+            return std::shared_ptr<void>();
+
+        size_t length = entry.st_size;
+        std::shared_ptr<void> mapping(data, [length](void* data) { munmap(data, length); });
+
+        const Header* header = (const Header*) data;
+
+        // A damaged entry is a miss, the key and the pixels have to lie within the file
+        if (memcmp(header->magic, "VOTC", 4) != 0 || !fits(*header, length) || !matches(*header, path, flags, source))
+            return std::shared_ptr<void>();
+
+        image = cv::Mat(header->rows, header->cols, header->type, (char*) data + header->offset);
+
+        return mapping;
+    }
+
+    /**
+     * Stores the decoded image. Errors are ignored, the cache is only an
+     * optimization.
+     */
+    void store(const std::string& path, int flags, const cv::Mat& image) const {
+
+        struct stat source;
+
+        if (image.empty() || !image.isContinuous() || stat(path.c_str(), &source) != 0)
+            return;
+
+        Header header;
+        memset(&header, 0, sizeof(Header));
+        memcpy(header.magic, "VOTC", 4);
+        header.modified = source.st_mtime;
+        header.size = source.st_size;
+        header.flags = flags;
+        header.rows = image.rows;
+        header.cols = image.cols;
+        header.type = image.type();
+        header.length = (int) path.size();
+        header.offset = (sizeof(Header) + path.size() + 63) & ~((size_t) 63);
+
+        std::string filename = entry_path(path, flags, source);
+        std::string temporary = filename + "." + std::to_string(getpid());
+
+        FILE* file = fopen(temporary.c_str(), "wb");
+
+        if (!file)
+            return;
+
+        std::vector<char> padding(header.offset - sizeof(Header) - path.size(), 0);
+
+        bool ok = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+            fwrite(path.data(), 1, path.size(), file) == path.size() &&
+            fwrite(padding.data(), 1, padding.size(), file) == padding.size() &&
+            fwrite(image.data, image.elemSize(), image.total(), file) == image.total();
+
+        if (fclose(file) != 0 || !ok || rename(temporary.c_str(), filename.c_str()) != 0)
+            unlink(temporary.c_str());
+
+    }
+
+private:
+
+    typedef struct Header {
+        char magic[4];
+        int flags;
+        long long modified;
+        long long size;
+        int rows;
+        int cols;
+        int type;
+        int length;
+        unsigned long long offset;
+    } Header;
+
+    static bool fits(const Header& header, size_t length) {
+
+        if (header.length < 0 || sizeof(Header) + (size_t) header.length > length ||
+            header.offset < sizeof(Header) + (size_t) header.length || header.offset > length)
+            return false;
+
+        if (header.rows <= 0 || header.cols <= 0 || header.type < 0 || header.type != CV_MAT_TYPE(header.type))
+            return false;
+
+        // Compared by division, the product of the dimensions could overflow
+        size_t available = (length - header.offset) / CV_ELEM_SIZE(header.type);
+
+        return (size_t) header.rows <= available / (size_t) header.cols;
+    }
+
+    static bool matches(const Header& header, const std::string& path, int flags, const struct stat& source) {
+        return header.flags == flags && header.modified == (long long) source.st_mtime &&
+            header.size == (long long) source.st_size && header.length == (int) path.size() &&
+            memcmp((const char*) &header + sizeof(Header), path.data(), path.size()) == 0;
+    }
+
+    // Entries are named by a FNV-1a hash of the key, the full key is checked on load
+    std::string entry_path(const std::string& path, int flags, const struct stat& source) const {
+
+        unsigned long long hash = 14695981039346656037ULL;
+        std::string key = path + ":" + std::to_string((long long) source.st_mtime) + ":" +
+            std::to_string((long long) source.st_size) + ":" + std::to_string(flags);
+
+        for (size_t i = 0; i < key.size(); i++) {
+            hash ^= (unsigned char) key[i];
+            hash *= 1099511628211ULL;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", hash);
+
+        return _directory + "/" + name;
+    }
+
+    std::string _directory;
+
+};
+
+/**
+ * Consumer side of the shared-memory frame channel. The client places decoded
+ * frames into a ring of slots in a POSIX shared-memory object and sends only
+ * a descriptor of the slot as an URL image:
+ *
+ *   shm:<name>?slot=<index>&seq=<sequence>&size=<bytes>
+ *
+ * The object starts with a 64 byte header (magic "VOTR", version, number of
+ * slots, slot capacity), followed by the slots. Each slot has a 64 byte header
+ * (sequence, size, width, height and TRAX_IMAGE_MEMORY_* format) followed by
+ * the pixels. The object is mapped read-only, a slot is only valid while its
+ * sequence matches the descriptor. The client may reuse a slot at any time,
+ * so the loader copies the pixels and discards the copy if the sequence of
+ * the slot changed while it was copied.
+ */
+class VOTFrameRing {
+public:
+
+    VOTFrameRing(const std::string& name) {
+
+        int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+
+        if (fd < 0)
+            return;
+
+        struct stat info;
+
+        if (fstat(fd, &info) == 0 && info.st_size >= 64) {
+            _length = info.st_size;
+            _data = (const char*) mmap(NULL, _length, PROT_READ, MAP_SHARED, fd, 0);
+            if (_data == MAP_FAILED)
+                _data = NULL;
+        }
+
+        close(fd);
+
+        if (!_data)
+            return;
+
+        // The client can rewrite the header later, the layout is only taken from the validated copy
+        Header header = *(const Header*) _data;
+
+        if (memcmp(header.magic, "VOTR", 4) != 0 || header.version != 1 || header.capacity > _length ||
+            (unsigned long long) header.slots > (_length - 64) / (64 + header.capacity)) {
+            munmap((void*) _data, _length);
+            _data = NULL;
+            return;
+        }
+
+        _slots = header.slots;
+        _capacity = (size_t) header.capacity;
+
+    }
+
+    ~VOTFrameRing() {
+        if (_data)
+            munmap((void*) _data, _length);
+    }
+
+    VOTFrameRing(const VOTFrameRing&) = delete;
+
+    VOTFrameRing& operator=(const VOTFrameRing&) = delete;
+
+    bool valid() const {
+        return _data != NULL;
+    }
+
+    /**
+     * Returns the pixels of the slot and its header or NULL if the slot does
+     * not exist, was already overwritten by the client or its header does not
+     * describe an image that fits into the slot.
+     */
+    const char* get(int slot, unsigned long long sequence, size_t size, int* width, int* height, int* format) const {
+
+        if (!_data)
+            return NULL;
+
+        if (slot < 0 || (unsigned int) slot >= _slots || size > _capacity)
+            return NULL;
+
+        const char* base = _data + 64 + (size_t) slot * (64 + _capacity);
+
+        // The client can write the slot concurrently, the header is checked on a copy
+        Slot info = *(const Slot*) base;
+
+        if (info.sequence != sequence || info.size != size)
+            return NULL;
+
+        int bytes = info.format == TRAX_IMAGE_MEMORY_RGB ? 3 : info.format == TRAX_IMAGE_MEMORY_GRAY16 ? 2 :
+            info.format == TRAX_IMAGE_MEMORY_GRAY8 ? 1 : 0;
+
+        if (info.width <= 0 || info.height <= 0 || bytes == 0 ||
+            (unsigned long long) info.width * (unsigned long long) info.height * bytes > info.size)
+            return NULL;
+
+        *width = info.width;
+        *height = info.height;
+        *format = info.format;
+
+        return base + 64;
+    }
+
+    /**
+     * True if the slot still holds the given sequence, checked after its
+     * pixels were copied.
+     */
+    bool current(int slot, unsigned long long sequence) const {
+
+        if (!_data || slot < 0 || (unsigned int) slot >= _slots)
+            return false;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        const volatile unsigned long long* current = (const volatile unsigned long long*) (_data + 64 + (size_t) slot * (64 + _capacity));
+
+        return *current == sequence;
+    }
+
+    /**
+     * Parses a slot descriptor, returns false if the URL is not a descriptor.
+     */
+    static bool parse(const std::string& url, std::string& name, int& slot, unsigned long long& sequence, size_t& size) {
+
+        if (url.compare(0, 4, "shm:") != 0)
+            return false;
+
+        size_t query = url.find('?');
+
+        if (query == std::string::npos)
+            return false;
+
+        name = url.substr(4, query - 4);
+        slot = -1;
+        sequence = 0;
+        size = 0;
+
+        while (query != std::string::npos) {
+            size_t next = url.find('&', query + 1);
+            std::string field = url.substr(query + 1, next == std::string::npos ? std::string::npos : next - query - 1);
+            unsigned long long value = strtoull(field.c_str() + field.find('=') + 1, NULL, 10);
+            if (field.compare(0, 5, "slot=") == 0) slot = (int) value;
+            else if (field.compare(0, 4, "seq=") == 0) sequence = value;
+            else if (field.compare(0, 5, "size=") == 0) size = (size_t) value;
+            query = next;
+        }
+
+        return !name.empty() && slot >= 0;
+    }
+
+private:
+
+    typedef struct Header {
+        char magic[4];
+        unsigned int version;
+        unsigned int slots;
+        unsigned int reserved;
+        unsigned long long capacity;
+    } Header;
+
+    typedef struct Slot {
+        unsigned long long sequence;
+        unsigned long long size;
+        int width;
+        int height;
+        int format;
+        int reserved;
+    } Slot;
+
+    const char* _data = NULL;
+
+    size_t _length = 0;
+
+    // Layout of the ring as validated when it was mapped
+    unsigned int _slots = 0;
+
+    size_t _capacity = 0;
+
+};
+
+#endif
+
+/**
+ * Decodes images of all channels of a frame. Channels are decoded
+ * concurrently, depth is optionally resized to the working resolution of the
+ * tracker and converted to meters. Buffers are reused between frames, so the
+ * returned frame is only valid until the next call to load. If the
+ * VOT_FRAME_CACHE environment variable is set, decoded images are cached in
+ * the directory it points to (see VOTFrameCache).
+ */
+class VOTFrameLoader {
+public:
+
+    enum DepthFormat {
+        DepthRaw,
+        DepthMetric
+    };
+
+    /**
+     * The depth scale converts raw depth values to meters (depth in the VOT
+     * sequences is stored in millimeters). If depth size is not empty, depth is
+     * resized to it using nearest neighbour interpolation.
+     */
+    VOTFrameLoader(DepthFormat depth_format = DepthMetric, float depth_scale = 0.001f, cv::Size depth_size = cv::Size(),
+        int color_flags = cv::IMREAD_COLOR, int ir_flags = cv::IMREAD_GRAYSCALE) :
+        _depth_format(depth_format), _depth_scale(depth_scale), _depth_size(depth_size), _color_flags(color_flags), _ir_flags(ir_flags) {
+#ifndef _WIN32
+        const char* directory = getenv("VOT_FRAME_CACHE");
+        if (directory && *directory)
+            cache(std::make_shared<VOTFrameCache>(directory));
+#endif
+    }
+
+#ifndef _WIN32
+    /**
+     * Sets the cache consulted before decoding images, the cache can be
+     * shared between loaders.
+     */
+    void cache(std::shared_ptr<VOTFrameCache> cache) {
+        _cache = cache;
+    }
+#endif
+
+    /**
+     * Sets the region of interest of the color channel for the following
+     * frames, an empty rectangle decodes whole images. Trackers that only
+     * search a window around the object set it to the window of the next
+     * frame. JPEG files are then decoded only for the intersecting blocks
+     * (with VOT_LIBJPEG) and PNG files only up to the last row of the region
+     * (with VOT_LIBPNG). The crop may be larger than the region since JPEG
+     * is decoded in whole blocks horizontally. Other images are decoded in
+     * full and cropped without a copy.
+     */
+    void roi(const cv::Rect& region) {
+        _roi = region;
+    }
+
+    const VOTFrame& load(const std::string& color, const std::string& depth) {
+
+        const std::string* paths[TRAX_CHANNELS] = {&color, &depth, NULL};
+        const trax_image* data[TRAX_CHANNELS] = {NULL, NULL, NULL};
+
+        return load(paths, data, TRAX_CHANNEL_COLOR | TRAX_CHANNEL_DEPTH);
+    }
+
+    /**
+     * Decodes the channels of the image that are selected by the channels mask
+     * (a combination of TRAX_CHANNEL_* flags), the remaining channels of the
+     * frame are released. The first channel is decoded on the calling thread,
+     * the others on worker threads.
+     */
+    const VOTFrame& load(const VOTImage& image, int channels = TRAX_CHANNEL_COLOR | TRAX_CHANNEL_DEPTH | TRAX_CHANNEL_IR) {
+
+        const std::string* paths[TRAX_CHANNELS] = {&image.color, &image.depth, &image.ir};
+
+        return load(paths, image.data, channels);
+    }
+
+private:
+
+    // Paths and images are indexed by TraX channel index, paths may be NULL
+    const VOTFrame& load(const std::string* const paths[], const trax_image* const data[], int channels) {
+
+        std::function<void()> decoders[TRAX_CHANNELS];
+        std::future<void> tasks[TRAX_CHANNELS];
+        cv::Mat* outputs[TRAX_CHANNELS] = {&_frame.color, &_frame.depth, &_frame.ir};
+        int count = 0;
+        static const std::string empty;
+
+        for (int i = 0; i < TRAX_CHANNELS; i++) {
+
+            const std::string& path = paths[i] ? *paths[i] : empty;
+
+            if (!(channels & TRAX_CHANNEL_ID(i)) || (path.empty() && !data[i])) {
+                outputs[i]->release();
+                _mapped[i].reset();
+                continue;
+            }
+
+            switch (TRAX_CHANNEL_ID(i)) {
+            case TRAX_CHANNEL_DEPTH:
+                decoders[count++] = [this, &path, data]() { decode_depth(path, data[1]); };
+                break;
+            case TRAX_CHANNEL_IR:
+                decoders[count++] = [this, &path, data]() { read(path, data[2], _ir_flags, _frame.ir, _mapped[2]); };
+                break;
+            default:
+                decoders[count++] = [this, &path, data]() { decode_color(path, data[0]); };
+            }
+
+        }
+
+        for (int i = 1; i < count; i++)
+            tasks[i] = std::async(std::launch::async, decoders[i]);
+
+        if (count > 0)
+            decoders[0]();
+
+        for (int i = 1; i < count; i++)
+            tasks[i].get();
+
+        return _frame;
+    }
+
+    /**
+     * Maps the image from the cache or decodes it and stores it to the cache.
+     * Images sent in memory are used directly if they already have the
+     * requested layout, otherwise they are converted without touching disk.
+     */
+    void read(const std::string& path, const trax_image* data, int flags, cv::Mat& image, std::shared_ptr<void>& mapping) {
+
+        image.release();
+        mapping.reset();
+
+        if (data) {
+            receive(data, flags, image);
+            return;
+        }
+
+#ifndef _WIN32
+        if (_cache) {
+            mapping = _cache->load(path, flags, image);
+            if (mapping)
+                return;
+        }
+#endif
+
+        image = cv::imread(path, flags);
+
+#ifndef _WIN32
+        if (_cache)
+            _cache->store(path, flags, image);
+#endif
+    }
+
+    void decode_color(const std::string& path, const trax_image* data) {
+
+        _frame.offset = cv::Point();
+
+        // Cached images are mapped in full, which is cheaper than a partial decode
+#ifndef _WIN32
+        bool partial = !data && !_roi.empty() && !_cache;
+#else
+        bool partial = !data && !_roi.empty();
+#endif
+
+        if (partial && decode_partial(path, _color_flags, _roi, _frame.color, _frame.offset, _frame.size)) {
+            _mapped[0].reset();
+            return;
+        }
+
+        read(path, data, _color_flags, _frame.color, _mapped[0]);
+
+        _frame.size = _frame.color.size();
+
+        if (!_roi.empty() && !_frame.color.empty()) {
+            cv::Rect crop = _roi & cv::Rect(cv::Point(), _frame.size);
+            _frame.color = crop.empty() ? cv::Mat() : _frame.color(crop);
+            _frame.offset = crop.tl();
+        }
+
+    }
+
+    /**
+     * Decodes the part of a JPEG or PNG file that intersects the region, for
+     * the flags that select 8 bit color or grayscale images. Returns false if
+     * the file has to be decoded in full.
+     */
+    static bool decode_partial(const std::string& path, int flags, const cv::Rect& roi, cv::Mat& image, cv::Point& offset, cv::Size& size) {
+
+        if (flags != cv::IMREAD_COLOR && flags != cv::IMREAD_GRAYSCALE)
+            return false;
+
+        FILE* file = fopen(path.c_str(), "rb");
+
+        if (!file)
+            return false;
+
+        unsigned char magic[8] = {0};
+        bool result = false;
+
+        if (fread(magic, 1, 8, file) == 8 && !fseek(file, 0, SEEK_SET)) {
+#ifdef VOT_LIBJPEG
+            if (magic[0] == 0xFF && magic[1] == 0xD8)
+                result = decode_jpeg(file, flags == cv::IMREAD_COLOR, roi, image, offset, size);
+#endif
+#ifdef VOT_LIBPNG
+            if (!png_sig_cmp(magic, 0, 8))
+                result = decode_png(file, flags == cv::IMREAD_COLOR, roi, image, offset, size);
+#endif
+        }
+
+        fclose(file);
+
+        return result;
+
+    }
+
+#ifdef VOT_LIBJPEG
+    struct _jpeg_error {
+        jpeg_error_mgr manager;
+        jmp_buf jump;
+    };
+
+    static void _jpeg_exit(j_common_ptr info) {
+        longjmp(((_jpeg_error*) info->err)->jump, 1);
+    }
+
+    static void _jpeg_message(j_common_ptr info) { }
+
+    static bool decode_jpeg(FILE* file, bool color, const cv::Rect& roi, cv::Mat& image, cv::Point& offset, cv::Size& size) {
+
+        jpeg_decompress_struct info;
+        _jpeg_error error;
+
+        info.err = jpeg_std_error(&error.manager);
+        error.manager.error_exit = _jpeg_exit;
+        error.manager.output_message = _jpeg_message;
+
+        if (setjmp(error.jump)) {
+            jpeg_destroy_decompress(&info);
+            return false;
+        }
+
+        jpeg_create_decompress(&info);
+        jpeg_stdio_src(&info, file);
+        jpeg_save_markers(&info, JPEG_APP0 + 1, 0xFFFF);
+        jpeg_read_header(&info, TRUE);
+
+        // imread applies the EXIF orientation, such images and CMYK images are decoded in full
+        bool supported = info.jpeg_color_space != JCS_CMYK && info.jpeg_color_space != JCS_YCCK;
+
+        for (jpeg_saved_marker_ptr marker = info.marker_list; marker; marker = marker->next) {
+            if (marker->marker == JPEG_APP0 + 1 && marker->data_length >= 4 && !memcmp(marker->data, "Exif", 4))
+                supported = false;
+        }
+
+        if (!supported) {
+            jpeg_destroy_decompress(&info);
+            return false;
+        }
+
+        info.out_color_space = color ? JCS_EXT_BGR : JCS_GRAYSCALE;
+
+        size = cv::Size(info.image_width, info.image_height);
+        cv::Rect crop = roi & cv::Rect(cv::Point(), size);
+
+        if (crop.empty()) {
+            jpeg_destroy_decompress(&info);
+            image.release();
+            offset = cv::Point();
+            return true;
+        }
+
+        jpeg_start_decompress(&info);
+
+        // The crop is widened to whole blocks, rows above it are skipped and rows below it are never decoded. Upsampled
+        // chroma is not exact in the edge columns of a crop, so one more column is decoded on each side and dropped.
+        JDIMENSION x = std::max(crop.x - 1, 0), width = std::min(crop.x + crop.width + 1, size.width) - x;
+        jpeg_crop_scanline(&info, &x, &width);
+        jpeg_skip_scanlines(&info, crop.y);
+
+        image.create(crop.height, (int) width, color ? CV_8UC3 : CV_8UC1);
+
+        while (info.output_scanline < (JDIMENSION) (crop.y + crop.height)) {
+            JSAMPROW row = image.ptr(info.output_scanline - crop.y);
+            jpeg_read_scanlines(&info, &row, 1);
+        }
+
+        jpeg_destroy_decompress(&info);
+
+        int first = x > 0 ? 1 : 0, last = (int) (x + width) < size.width ? (int) width - 1 : (int) width;
+
+        image = image.colRange(first, last);
+        offset = cv::Point(x + first, crop.y);
+
+        return true;
+
+    }
+#endif
+
+#ifdef VOT_LIBPNG
+    static void _png_warning(png_structp png, png_const_charp message) { }
+
+    static bool decode_png(FILE* file, bool color, const cv::Rect& roi, cv::Mat& image, cv::Point& offset, cv::Size& size) {
+
+        png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, _png_warning);
+        png_infop info = png ? png_create_info_struct(png) : NULL;
+
+        if (!info) {
+            png_destroy_read_struct(&png, NULL, NULL);
+            return false;
+        }
+
+        if (setjmp(png_jmpbuf(png))) {
+            png_destroy_read_struct(&png, &info, NULL);
+            return false;
+        }
+
+        png_init_io(png, file);
+        png_read_info(png, info);
+
+        // Rows of interlaced images can not be read in order
+        if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+            png_destroy_read_struct(&png, &info, NULL);
+            return false;
+        }
+
+        // Same conversions as imread for 8 bit color and grayscale images
+        int type = png_get_color_type(png, info);
+
+        if (png_get_bit_depth(png, info) == 16)
+            png_set_strip_16(png);
+        if (type == PNG_COLOR_TYPE_PALETTE)
+            png_set_palette_to_rgb(png);
+        if (type == PNG_COLOR_TYPE_GRAY && png_get_bit_depth(png, info) < 8)
+            png_set_expand_gray_1_2_4_to_8(png);
+        if (type & PNG_COLOR_MASK_ALPHA)
+            png_set_strip_alpha(png);
+
+        if (color) {
+            if (!(type & PNG_COLOR_MASK_COLOR))
+                png_set_gray_to_rgb(png);
+            png_set_bgr(png);
+        } else if (type & PNG_COLOR_MASK_COLOR) {
+            png_set_rgb_to_gray(png, 1, 0.299, 0.587);
+        }
+
+        png_read_update_info(png, info);
+
+        int channels = color ? 3 : 1;
+
+        if (png_get_channels(png, info) != channels || png_get_bit_depth(png, info) != 8) {
+            png_destroy_read_struct(&png, &info, NULL);
+            return false;
+        }
+
+        size = cv::Size(png_get_image_width(png, info), png_get_image_height(png, info));
+        cv::Rect crop = roi & cv::Rect(cv::Point(), size);
+
+        std::vector<unsigned char> row(png_get_rowbytes(png, info));
+
+        if (crop.empty())
+            image.release();
+        else
+            image.create(crop.height, crop.width, color ? CV_8UC3 : CV_8UC1);
+
+        // Errors from here on jump to a point after the row buffer is allocated
+        if (setjmp(png_jmpbuf(png))) {
+            png_destroy_read_struct(&png, &info, NULL);
+            return false;
+        }
+
+        // Rows are read up to the last row of the crop, the rest of the file is not decompressed
+        for (int y = 0; y < crop.y + crop.height; y++) {
+            png_read_row(png, row.data(), NULL);
+            if (y >= crop.y)
+                memcpy(image.ptr(y - crop.y), row.data() + crop.x * channels, crop.width * channels);
+        }
+
+        png_destroy_read_struct(&png, &info, NULL);
+
+        offset = crop.tl();
+
+        return true;
+
+    }
+#endif
+
+    void receive(const trax_image* data, int flags, cv::Mat& image) {
+
+        int width, height, format;
+
+        switch (trax_image_get_type(data)) {
+        case TRAX_IMAGE_BUFFER: {
+            int length;
+            const char* buffer = trax_image_get_buffer(data, &length, &format);
+            image = cv::imdecode(cv::Mat(1, length, CV_8UC1, (void*) buffer), flags);
+            break;
+        }
+        case TRAX_IMAGE_MEMORY:
+            trax_image_get_memory_header(data, &width, &height, &format);
+            wrap((void*) trax_image_get_memory_row(data, 0), width, height, format, flags, image);
+            break;
+#ifndef _WIN32
+        case TRAX_IMAGE_URL: {
+            std::string name;
+            int slot;
+            unsigned long long sequence;
+            size_t size;
+            if (!VOTFrameRing::parse(trax_image_get_url(data), name, slot, sequence, size))
+                break;
+            std::shared_ptr<VOTFrameRing> mapped = ring(name);
+            const char* pixels = mapped->get(slot, sequence, size, &width, &height, &format);
+            if (!pixels)
+                break;
+            wrap((void*) pixels, width, height, format, flags, image);
+            // Pixels that were used in place are copied, the frame is lost if the client reused the slot meanwhile
+            if ((const void*) image.data == (const void*) pixels)
+                image = image.clone();
+            if (!mapped->current(slot, sequence))
+                image.release();
+            break;
+        }
+#endif
+        }
+
+    }
+
+#ifndef _WIN32
+    // Rings are mapped once per name and shared by all channels
+    std::shared_ptr<VOTFrameRing> ring(const std::string& name) {
+
+        std::lock_guard<std::mutex> lock(_rings.lock);
+
+        std::shared_ptr<VOTFrameRing>& ring = _rings.mapped[name];
+
+        if (!ring || !ring->valid())
+            ring = std::make_shared<VOTFrameRing>(name);
+
+        return ring;
+    }
+#endif
+
+    static void wrap(void* pixels, int width, int height, int format, int flags, cv::Mat& image) {
+
+        // Same channel conversions as imread, color images are stored as BGR
+        bool color = flags == cv::IMREAD_UNCHANGED || (flags & cv::IMREAD_COLOR);
+
+        switch (format) {
+        case TRAX_IMAGE_MEMORY_RGB:
+            cv::cvtColor(cv::Mat(height, width, CV_8UC3, pixels), image, color ? cv::COLOR_RGB2BGR : cv::COLOR_RGB2GRAY);
+            break;
+        case TRAX_IMAGE_MEMORY_GRAY8:
+            if (color && flags != cv::IMREAD_UNCHANGED)
+                cv::cvtColor(cv::Mat(height, width, CV_8UC1, pixels), image, cv::COLOR_GRAY2BGR);
+            else
+                image = cv::Mat(height, width, CV_8UC1, pixels);
+            break;
+        case TRAX_IMAGE_MEMORY_GRAY16:
+            image = cv::Mat(height, width, CV_16UC1, pixels);
+            break;
+        }
+
+    }
+
+    void decode_depth(const std::string& path, const trax_image* data) {
+
+        read(path, data, cv::IMREAD_ANYDEPTH, _raw, _mapped[1]);
+
+        if (_raw.empty()) {
+            _frame.depth.release();
+            return;
+        }
+
+        const cv::Mat* source = &_raw;
+
+        if (!_depth_size.empty() && _raw.size() != _depth_size) {
+            cv::resize(_raw, _resized, _depth_size, 0, 0, cv::INTER_NEAREST);
+            source = &_resized;
+        }
+
+        if (_depth_format == DepthMetric)
+            source->convertTo(_frame.depth, CV_32F, _depth_scale);
+        else
+            _frame.depth = *source;
+
+    }
+
+    DepthFormat _depth_format;
+
+    float _depth_scale;
+
+    cv::Size _depth_size;
+
+    int _color_flags;
+
+    int _ir_flags;
+
+    cv::Rect _roi;
+
+    cv::Mat _raw;
+
+    cv::Mat _resized;
+
+    VOTFrame _frame;
+
+    // Cache mappings backing the decoded channels of the current frame
+    std::shared_ptr<void> _mapped[TRAX_CHANNELS];
+
+#ifndef _WIN32
+    std::shared_ptr<VOTFrameCache> _cache;
+
+    // Mapped rings, channels are decoded concurrently so access is locked, copies of the loader start empty
+    struct Rings {
+        Rings() { }
+        Rings(const Rings&) { }
+        Rings& operator=(const Rings&) { return *this; }
+        std::map<std::string, std::shared_ptr<VOTFrameRing> > mapped;
+        std::mutex lock;
+    } _rings;
+#endif
+
+};
+
+#endif
+
+/**
+ * Spans of the tracking loop in the trace event format of Chrome
+ * (chrome://tracing) and Perfetto, used by VOTManager. Tracing is enabled by
+ * setting the VOT_TRACE environment variable to the output file. Spans are
+ * kept in memory and written when the trace is destroyed, a disabled trace
+ * does not read the clock.
+ */
+class VOTTrace {
+
+public:
+
+    typedef std::chrono::steady_clock clock;
+
+    /**
+     * Measures the lifetime of the span, object is the index of the object
+     * that the span belongs to or -1.
+     */
+    class Span {
+
+    public:
+
+        Span(VOTTrace& trace, const char* name, int object = -1) : _trace(trace.enabled() ? &trace : NULL), _name(name), _object(object) {
+            if (_trace)
+                _begin = clock::now();
+        }
+
+        ~Span() {
+            if (_trace)
+                _trace->add(_name, _begin, clock::now(), _object);
+        }
+
+    private:
+
+        VOTTrace* _trace;
+        const char* _name;
+        int _object;
+        clock::time_point _begin;
+
+    };
+
+    VOTTrace() {
+        const char* file = getenv("VOT_TRACE");
+        if (file && *file) {
+            _file = file;
+            _start = clock::now();
+        }
+    }
+
+    ~VOTTrace() {
+        write();
+    }
+
+    bool enabled() const {
+        return !_file.empty();
+    }
+
+    /**
+     * Sets the frame number that is attached to the following spans.
+     */
+    void frame(int frame) {
+        _frame = frame;
+    }
+
+    /**
+     * Adds a span, names have to be string literals. Can be called from any
+     * thread, threads are numbered in the order of their first span.
+     */
+    void add(const char* name, clock::time_point begin, clock::time_point end, int object = -1) {
+
+        std::lock_guard<std::mutex> lock(_lock);
+
+        std::thread::id thread = std::this_thread::get_id();
+        size_t index = 0;
+
+        while (index < _threads.size() && _threads[index] != thread)
+            index++;
+
+        if (index == _threads.size())
+            _threads.push_back(thread);
+
+        _events.push_back({name, begin, end, object, _frame, (int) index + 1});
+
+    }
+
+    void write() {
+
+        if (!enabled())
+            return;
+
+        std::lock_guard<std::mutex> lock(_lock);
+        std::ofstream output(_file);
+
+#ifndef _WIN32
+        int pid = (int) getpid();
+#else
+        int pid = 1;
+#endif
+
+        // Times are in microseconds
+        output << std::fixed;
+        output.precision(3);
+
+        output << "{\"traceEvents\":[";
+
+        for (size_t i = 0; i < _events.size(); i++) {
+            const Event& event = _events[i];
+            output << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"vot\",\"ph\":\"X\",\"ts\":"
+                << std::chrono::duration<double, std::micro>(event.begin - _start).count() << ",\"dur\":"
+                << std::chrono::duration<double, std::micro>(event.end - event.begin).count() << ",\"pid\":" << pid
+                << ",\"tid\":" << event.thread << ",\"args\":{\"frame\":" << event.frame;
+            if (event.object >= 0)
+                output << ",\"object\":" << event.object;
+            output << "}}";
+        }
+
+        output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    }
+
+private:
+
+    struct Event {
+        const char* name;
+        clock::time_point begin;
+        clock::time_point end;
+        int object;
+        int frame;
+        int thread;
+    };
+
+    std::string _file;
+
+    clock::time_point _start;
+
+    int _frame = 0;
+
+    std::vector<Event> _events;
+
+    std::vector<std::thread::id> _threads;
+
+    std::mutex _lock;
+
+};
+
+/**
+ * Per-frame time budget for real-time experiments. The deadline of a frame
+ * is the time of its arrival plus the budget. Objects whose update would not
+ * finish before the deadline are skipped and reported as a constant-velocity
+ * extrapolation of their last measured regions, their trackers catch up on
+ * a later frame. Update costs are measured as an exponential moving average.
+ * An object is never skipped on more than a limited number of consecutive
+ * frames, so it is updated even if its update alone exceeds the budget.
+ */
+class VOTBudget {
+
+public:
+
+    typedef std::chrono::steady_clock clock;
+
+    /**
+     * Creates a budget of the given number of seconds per frame, a budget that
+     * is not positive disables skipping.
+     */
+    VOTBudget(double seconds = 0, int limit = 5) : _budget(seconds), _limit(limit) { }
+
+    VOTBudget(const VOTBudget&) = delete;
+
+    VOTBudget& operator= (const VOTBudget&) = delete;
+
+    ~VOTBudget() {
+        clear();
+    }
+
+    bool enabled() const {
+        return _budget > 0;
+    }
+
+    void set(double seconds) {
+        _budget = seconds;
+    }
+
+    /**
+     * Marks the arrival of a new frame and starts its deadline.
+     */
+    void start() {
+        _frame++;
+        _deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(_budget));
+    }
+
+    /**
+     * Order in which objects should be updated. Objects that were skipped on
+     * more frames come first, then the ones with lower confidence and then the
+     * cheaper ones, so more objects fit into the budget.
+     */
+    std::vector<int> order(int count) {
+
+        std::vector<int> result(count);
+
+        for (int i = 0; i < count; i++)
+            result[i] = i;
+
+        if (!enabled() || count == 0)
+            return result;
+
+        state(count - 1);
+
+        std::stable_sort(result.begin(), result.end(), [this](int a, int b) {
+            const Object& first = _objects[a];
+            const Object& second = _objects[b];
+            if (first.skipped != second.skipped)
+                return first.skipped > second.skipped;
+            if (first.confidence != second.confidence)
+                return first.confidence < second.confidence;
+            return first.cost < second.cost;
+        });
+
+        return result;
+
+    }
+
+    /**
+     * True if the update of the object is expected to finish before the
+     * deadline of the current frame or the object can not be skipped again.
+     */
+    bool admit(int object) {
+
+        if (!enabled())
+            return true;
+
+        const Object& current = state(object);
+
+        if (current.skipped >= _limit)
+            return true;
+
+        return clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(current.cost)) <= _deadline;
+
+    }
+
+    /**
+     * Starts the motion model of an object with its initial region.
+     */
+    void reset(int object, const VOTRegion& region) {
+
+        Object& current = state(object);
+
+        current.release();
+        current.region = region.to_trax();
+        current.frame = _frame;
+        current.dx = current.dy = 0;
+        current.skipped = 0;
+        current.confidence = 1;
+
+    }
+
+    /**
+     * Records an update of the object that took the given number of seconds.
+     */
+    void measured(int object, const VOTRegion& region, double seconds, float confidence = 1) {
+
+        Object& current = state(object);
+        trax_region* next = region.to_trax();
+
+        // Velocity in pixels per frame between the bounds centers of the last two measurements
+        if (current.region && _frame > current.frame) {
+            trax_bounds before = trax_region_bounds(current.region);
+            trax_bounds after = trax_region_bounds(next);
+            current.dx = ((after.left + after.right) - (before.left + before.right)) / (2.0f * (_frame - current.frame));
+            current.dy = ((after.top + after.bottom) - (before.top + before.bottom)) / (2.0f * (_frame - current.frame));
+        }
+
+        current.release();
+        current.region = next;
+        current.frame = _frame;
+        current.cost = current.measured ? current.cost * 0.8 + seconds * 0.2 : seconds;
+        current.measured = true;
+        current.confidence = confidence;
+        current.skipped = 0;
+
+    }
+
+    /**
+     * Skips the object on the current frame and returns the extrapolation of
+     * its last measured region.
+     */
+    VOTRegion skip(int object) {
+
+        Object& current = state(object);
+
+        current.skipped++;
+
+        trax_region* region = _shift(current.region, current.dx * (_frame - current.frame), current.dy * (_frame - current.frame));
+        VOTRegion result = VOTRegion::from_trax(region);
+        trax_region_release(&region);
+
+        return result;
+
+    }
+
+    void clear() {
+
+        for (size_t i = 0; i < _objects.size(); i++)
+            _objects[i].release();
+
+        _objects.clear();
+
+    }
+
+private:
+
+    struct Object {
+        trax_region* region = NULL;
+        int frame = 0;
+        float dx = 0;
+        float dy = 0;
+        double cost = 0;
+        bool measured = false;
+        float confidence = 1;
+        int skipped = 0;
+
+        void release() {
+            if (region)
+                trax_region_release(&region);
+        }
+    };
+
+    Object& state(int object) {
+
+        if (object >= (int) _objects.size())
+            _objects.resize(object + 1);
+
+        return _objects[object];
+
+    }
+
+    // Returns a copy of the region moved by the offset, masks are moved by whole pixels
+    static trax_region* _shift(const trax_region* region, float dx, float dy) {
+
+        if (!region)
+            return trax_region_create_rectangle(0, 0, 0, 0);
+
+        switch (trax_region_get_type(region)) {
+        case TRAX_REGION_RECTANGLE: {
+            float x, y, width, height;
+            trax_region_get_rectangle(region, &x, &y, &width, &height);
+            return trax_region_create_rectangle(x + dx, y + dy, width, height);
+        }
+        case TRAX_REGION_POLYGON: {
+            int count = trax_region_get_polygon_count(region);
+            trax_region* result = trax_region_create_polygon(count);
+            for (int i = 0; i < count; i++) {
+                float x, y;
+                trax_region_get_polygon_point(region, i, &x, &y);
+                trax_region_set_polygon_point(result, i, x + dx, y + dy);
+            }
+            return result;
+        }
+        case TRAX_REGION_MASK: {
+            int x, y, width, height;
+            trax_region_get_mask_header(region, &x, &y, &width, &height);
+            // The mask offset can not be negative, masks that would leave the image stay at its border
+            trax_region* result = trax_region_create_mask(std::max(0, x + (int) std::lround(dx)), std::max(0, y + (int) std::lround(dy)), width, height);
+            for (int i = 0; i < height; i++)
+                memcpy(trax_region_write_mask_row(result, i), trax_region_get_mask_row(region, i), width);
+            return result;
+        }
+        default:
+            return trax_region_clone(region);
+        }
+
+    }
+
+    double _budget;
+
+    int _limit;
+
+    int _frame = 0;
+
+    clock::time_point _deadline;
+
+    std::vector<Object> _objects;
+
+};
+
+/**
+ * Runs expensive setup of a tracker (loading weights, building caches) in a
+ * background thread while the wrapper waits for the client. Start it before
+ * the VOT handle is created, the handshake blocks until the client sends the
+ * first frame, and call wait() right before the setup is first used. Wait
+ * rethrows an exception of the setup, the destructor joins the thread.
+ */
+class VOTStartup {
+
+public:
+
+    VOTStartup() { }
+
+    VOTStartup(std::function<void()> setup) {
+        start(std::move(setup));
+    }
+
+    VOTStartup(const VOTStartup&) = delete;
+
+    VOTStartup& operator=(const VOTStartup&) = delete;
+
+    ~VOTStartup() {
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    void start(std::function<void()> setup) {
+
+        wait();
+
+        _thread = std::thread([this, setup]() {
+            try {
+                setup();
+            } catch (...) {
+                _error = std::current_exception();
+            }
+        });
+
+    }
+
+    /**
+     * Waits for the setup to finish, does nothing if it was not started or
+     * has already been waited for.
+     */
+    void wait() {
+
+        if (_thread.joinable())
+            _thread.join();
+
+        if (_error) {
+            std::exception_ptr error = _error;
+            _error = nullptr;
+            std::rethrow_exception(error);
+        }
+
+    }
+
+private:
+
+    std::thread _thread;
+
+    std::exception_ptr _error;
+
+};
+
+#ifdef VOT_MULTI_OBJECT
+
+/**
+ * Base class for trackers that read images themselves, the manager passes
+ * them paths of the images.
+ */
+class VOTTracker {
+
+public:
+
+    VOTTracker(const VOTImage& image, const VOTRegion& region) { }
+
+    virtual ~VOTTracker() { }
+
+    virtual VOTRegion update(const VOTImage& image) = 0;
+
+};
+
+#ifdef VOT_OPENCV
+
+/**
+ * Base class for trackers that work with decoded images. The manager decodes
+ * each frame once and shares it between all objects.
+ */
+class VOTFrameTracker {
+
+public:
+
+    VOTFrameTracker(const VOTFrame& frame, const VOTRegion& region) { }
+
+    virtual ~VOTFrameTracker() { }
+
+    virtual VOTRegion update(const VOTFrame& frame) = 0;
+
+};
+
+/**
+ * True if the tracker is constructed from decoded frames instead of paths.
+ */
+template <typename T>
+struct vot_tracker_decodes : std::is_constructible<T, const VOTFrame&, const VOTRegion&> { };
+
+#endif
+
+/**
+ * Channels requested by a tracker. A tracker class can declare the channels
+ * it needs with a static constexpr int channels member (a combination of
+ * TRAX_CHANNEL_* flags), otherwise the channels selected by the configuration
+ * macros are used.
+ */
+template <typename T, typename = void>
+struct vot_tracker_channels : std::integral_constant<int, _VOT_CHANNELS> { };
+
+template <typename T>
+struct vot_tracker_channels<T, std::void_t<decltype(T::channels)>> : std::integral_constant<int, T::channels> { };
+
+/**
+ * Image formats accepted by a tracker (a combination of TRAX_IMAGE_* flags),
+ * declared with a static constexpr int images member. Trackers that work with
+ * decoded frames accept images in memory, encoded buffers and shared-memory
+ * descriptors by default, others only paths.
+ */
+template <typename T, typename = void>
+#ifdef VOT_OPENCV
+struct vot_tracker_images : std::integral_constant<int, vot_tracker_decodes<T>::value ?
+    (TRAX_IMAGE_PATH | TRAX_IMAGE_MEMORY | TRAX_IMAGE_BUFFER | TRAX_IMAGE_URL) : TRAX_IMAGE_PATH> { };
+#else
+struct vot_tracker_images : std::integral_constant<int, TRAX_IMAGE_PATH> { };
+#endif
+
+template <typename T>
+struct vot_tracker_images<T, std::void_t<decltype(T::images)>> : std::integral_constant<int, T::images> { };
+
+/**
+ * True if the tracker reports the confidence of its last update with a
+ * confidence() member, used to prioritize objects under a time budget.
+ */
+template <typename T, typename = void>
+struct vot_tracker_confidence : std::false_type { };
+
+template <typename T>
+struct vot_tracker_confidence<T, std::void_t<decltype(std::declval<const T&>().confidence())>> : std::true_type { };
+
+/**
+ * True if the tracker has to be notified with a skip() member when its update
+ * is skipped to meet a time budget, for instance to keep count of frames.
+ */
+template <typename T, typename = void>
+struct vot_tracker_skips : std::false_type { };
+
+template <typename T>
+struct vot_tracker_skips<T, std::void_t<decltype(std::declval<T&>().skip())>> : std::true_type { };
+
+/**
+ * True if updates of different objects can run concurrently, declared with a
+ * static constexpr bool parallel member. Trackers that share state between
+ * objects are updated serially by default.
+ */
+template <typename T, typename = void>
+struct vot_tracker_parallel : std::false_type { };
+
+template <typename T>
+struct vot_tracker_parallel<T, std::void_t<decltype(T::parallel)>> : std::integral_constant<bool, T::parallel> { };
+
+/**
+ * True if the tracker has a static prepare() member for setup that is shared
+ * by all objects. The manager runs it with VOTStartup during the handshake.
+ */
+template <typename T, typename = void>
+struct vot_tracker_prepares : std::false_type { };
+
+template <typename T>
+struct vot_tracker_prepares<T, std::void_t<decltype(T::prepare())>> : std::true_type { };
+
+/**
+ * Number of threads a tracker process may use, the cores in its affinity
+ * mask (on Linux) or the VOT_THREADS environment variable if it is set.
+ */
+inline int vot_thread_budget() {
+
+    const char* threads = getenv("VOT_THREADS");
+
+    if (threads && atoi(threads) > 0)
+        return atoi(threads);
+
+#ifdef __linux__
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+        return std::max(1, CPU_COUNT(&mask));
+#endif
+
+    return std::max(1, (int) std::thread::hardware_concurrency());
+
+}
+
+/**
+ * Persistent threads that run a task together with the calling thread. Each
+ * participant gets its index, 0 is the calling thread. On Linux participant
+ * k can be pinned to the k-th slice of the cores of the process, so threads
+ * that a task starts (OpenCV starts its pool lazily) stay on that slice. The
+ * calling thread keeps the affinity of the process.
+ */
+class VOTWorkers {
+
+public:
+
+    VOTWorkers() {
+#ifdef __linux__
+        if (sched_getaffinity(0, sizeof(_mask), &_mask) != 0)
+            CPU_ZERO(&_mask);
+#endif
+    }
+
+    VOTWorkers(const VOTWorkers&) = delete;
+
+    VOTWorkers& operator= (const VOTWorkers&) = delete;
+
+    ~VOTWorkers() {
+
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _stop = true;
+        }
+
+        _start.notify_all();
+
+        for (size_t i = 0; i < _threads.size(); i++)
+            _threads[i].join();
+
+    }
+
+    /**
+     * Runs the task on the given number of participants and waits for all of
+     * them to finish.
+     */
+    void run(int count, const std::function<void(int)>& task) {
+
+        while ((int) _threads.size() < count - 1) {
+            int index = (int) _threads.size() + 1;
+            _threads.emplace_back([this, index, generation = _generation]() { loop(index, generation); });
+            apply(index);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _task = &task;
+            _count = count;
+            _pending = count - 1;
+            _generation++;
+        }
+
+        _start.notify_all();
+
+        task(0);
+
+        std::unique_lock<std::mutex> lock(_lock);
+        _done.wait(lock, [this]() { return _pending == 0; });
+        _task = NULL;
+
+    }
+
+    /**
+     * Pins participants to consecutive slices of the given number of cores,
+     * a slice of zero restores the affinity of the process.
+     */
+    void pin(int slice) {
+
+        _slice = slice;
+
+        for (size_t k = 1; k <= _threads.size(); k++)
+            apply((int) k);
+
+    }
+
+private:
+
+    void apply(int index) {
+
+#ifdef __linux__
+        if (!index || !CPU_COUNT(&_mask))
+            return;
+
+        std::vector<int> cores;
+
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &_mask))
+                cores.push_back(i);
+        }
+
+        cpu_set_t mask = _mask;
+
+        // Participants that do not get a whole slice run on all cores of the process
+        if (_slice > 0 && (index + 1) * _slice <= (int) cores.size()) {
+            CPU_ZERO(&mask);
+            for (int i = index * _slice; i < (index + 1) * _slice; i++)
+                CPU_SET(cores[i], &mask);
+        }
+
+        pthread_setaffinity_np(_threads[index - 1].native_handle(), sizeof(mask), &mask);
+#endif
+
+    }
+
+    void loop(int index, int generation) {
+
+        while (true) {
+
+            std::unique_lock<std::mutex> lock(_lock);
+            _start.wait(lock, [&]() { return _stop || _generation != generation; });
+
+            if (_stop)
+                return;
+
+            generation = _generation;
+
+            if (index >= _count)
+                continue;
+
+            const std::function<void(int)>* task = _task;
+            lock.unlock();
+
+            (*task)(index);
+
+            lock.lock();
+
+            if (--_pending == 0)
+                _done.notify_one();
+
+        }
+
+    }
+
+    std::vector<std::thread> _threads;
+
+    std::mutex _lock;
+
+    std::condition_variable _start;
+
+    std::condition_variable _done;
+
+    const std::function<void(int)>* _task = NULL;
+
+    int _count = 0;
+
+    int _pending = 0;
+
+    int _generation = 0;
+
+    bool _stop = false;
+
+    int _slice = 0;
+
+#ifdef __linux__
+    cpu_set_t _mask;
+#endif
+
+};
+
+#ifndef _WIN32
+
+/**
+ * Stored results of deterministic trackers, used by VOTManager if the
+ * VOT_RESULT_CACHE environment variable points to a directory. A run is
+ * keyed by the identity of the tracker (its executable, type and declared
+ * parameters), the initial objects and the content of the first image. Each
+ * following frame extends the key with the content of its images and the
+ * objects that start or finish on it, so a frame is only found if all
+ * frames before it match. Only images sent as paths are hashed, runs with
+ * other images are not cached. Runs are written atomically when they end,
+ * a run that diverges from the stored one replaces it.
+ */
+class VOTResultCache {
+public:
+
+    VOTResultCache(const std::string& directory, const std::string& identity) : _directory(directory), _identity(identity) {
+        mkdir(directory.c_str(), 0777);
+    }
+
+    ~VOTResultCache() {
+        finish();
+    }
+
+    /**
+     * FNV-1a hash of the content of the running executable or an empty
+     * string if it can not be read.
+     */
+    static std::string executable() {
+
+#ifdef __linux__
+        unsigned long long value = _seed;
+
+        if (!hash_file(value, "/proc/self/exe"))
+            return std::string();
+
+        return hex(value);
+#else
+        return std::string();
+#endif
+
+    }
+
+    /**
+     * Starts a run. Returns true if results of a run with the same key are
+     * stored.
+     */
+    bool start(const VOTImage& image, const std::vector<VOTRegion>& objects) {
+
+        finish();
+
+        _records.clear();
+        _position = 0;
+        _changed = false;
+        _active = true;
+        _chain = _seed;
+
+        hash(_chain, _identity.data(), _identity.size());
+        extend(image, objects, std::vector<int>());
+
+        if (!_active)
+            return false;
+
+        _file = _directory + "/" + hex(_chain) + ".run";
+
+        load();
+
+        return !_records.empty();
+
+    }
+
+    /**
+     * Extends the key with a frame and returns its stored results if they
+     * exist. Stored results after a frame that does not match are dropped.
+     */
+    bool next(const VOTImage& image, const std::vector<VOTRegion>& added, const std::vector<int>& retired, std::vector<VOTRegion>& results) {
+
+        if (!_active)
+            return false;
+
+        extend(image, added, retired);
+
+        if (!_active)
+            return false;
+
+        if (_position < _records.size() && _records[_position].chain == _chain) {
+
+            results.clear();
+
+            for (const std::string& text : _records[_position].results) {
+                trax_region* region = trax_region_decode(text.c_str());
+                results.push_back(VOTRegion::from_trax(region));
+                trax_region_release(&region);
+            }
+
+            _position++;
+
+            return true;
+
+        }
+
+        if (_position < _records.size()) {
+            _records.resize(_position);
+            _changed = true;
+        }
+
+        return false;
+
+    }
+
+    /**
+     * Stores the results of the last frame passed to next().
+     */
+    void store(const std::vector<VOTRegion>& results) {
+
+        if (!_active)
+            return;
+
+        Record record;
+        record.chain = _chain;
+
+        for (const VOTRegion& result : results) {
+            trax_region* region = result.to_trax();
+            char* text = trax_region_encode(region);
+            record.results.push_back(text);
+            free(text);
+            trax_region_release(&region);
+        }
+
+        _records.push_back(record);
+        _position = _records.size();
+        _changed = true;
+
+    }
+
+    /**
+     * Writes the run if it has changed. Errors are ignored, the cache is
+     * only an optimization.
+     */
+    void finish() {
+
+        if (!_active || !_changed || _file.empty())
+            return;
+
+        _changed = false;
+
+        std::string temporary = _file + "." + std::to_string(getpid());
+        FILE* file = fopen(temporary.c_str(), "wb");
+
+        if (!file)
+            return;
+
+        bool ok = fwrite("VOTK", 1, 4, file) == 4;
+
+        for (size_t i = 0; ok && i < _records.size(); i++) {
+
+            unsigned int count = (unsigned int) _records[i].results.size();
+            ok = fwrite(&_records[i].chain, sizeof(_records[i].chain), 1, file) == 1 && fwrite(&count, sizeof(count), 1, file) == 1;
+
+            for (size_t j = 0; ok && j < count; j++) {
+                const std::string& text = _records[i].results[j];
+                unsigned int length = (unsigned int) text.size();
+                ok = fwrite(&length, sizeof(length), 1, file) == 1 && fwrite(text.data(), 1, length, file) == length;
+            }
+
+        }
+
+        if (fclose(file) != 0 || !ok || rename(temporary.c_str(), _file.c_str()) != 0)
+            unlink(temporary.c_str());
+
+    }
+
+private:
+
+    struct Record {
+        unsigned long long chain;
+        std::vector<std::string> results;
+    };
+
+    static constexpr unsigned long long _seed = 14695981039346656037ULL;
+
+    static void hash(unsigned long long& value, const void* data, size_t length) {
+
+        const unsigned char* bytes = (const unsigned char*) data;
+
+        for (size_t i = 0; i < length; i++) {
+            value ^= bytes[i];
+            value *= 1099511628211ULL;
+        }
+
+    }
+
+    static bool hash_file(unsigned long long& value, const std::string& path) {
+
+        FILE* file = fopen(path.c_str(), "rb");
+
+        if (!file)
+            return false;
+
+        char buffer[65536];
+        size_t length;
+
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            hash(value, buffer, length);
+
+        bool ok = !ferror(file);
+
+        fclose(file);
+
+        return ok;
+
+    }
+
+    static std::string hex(unsigned long long value) {
+
+        char text[32];
+        snprintf(text, sizeof(text), "%016llx", value);
+
+        return text;
+
+    }
+
+    // Adds the content of the images and the listed objects to the key, images that are not paths disable the run
+    void extend(const VOTImage& image, const std::vector<VOTRegion>& objects, const std::vector<int>& retired) {
+
+        const std::string* paths[TRAX_CHANNELS] = {&image.color, &image.depth, &image.ir};
+
+        for (int i = 0; i < TRAX_CHANNELS; i++) {
+
+            if (image.data[i]) {
+                _active = false;
+                return;
+            }
+
+            unsigned char marker = paths[i]->empty() ? 0 : 1;
+            hash(_chain, &marker, 1);
+
+            if (marker && !hash_file(_chain, *paths[i])) {
+                _active = false;
+                return;
+            }
+
+        }
+
+        for (const VOTRegion& object : objects) {
+            trax_region* region = object.to_trax();
+            char* text = trax_region_encode(region);
+            hash(_chain, text, strlen(text) + 1);
+            free(text);
+            trax_region_release(&region);
+        }
+
+        unsigned int count = (unsigned int) objects.size();
+        hash(_chain, &count, sizeof(count));
+
+        for (int index : retired)
+            hash(_chain, &index, sizeof(index));
+
+        count = (unsigned int) retired.size();
+        hash(_chain, &count, sizeof(count));
+
+    }
+
+    void load() {
+
+        FILE* file = fopen(_file.c_str(), "rb");
+
+        if (!file)
+            return;
+
+        char magic[4];
+        bool ok = fread(magic, 1, 4, file) == 4 && !memcmp(magic, "VOTK", 4);
+
+        while (ok) {
+
+            Record record;
+            unsigned int count;
+
+            if (fread(&record.chain, sizeof(record.chain), 1, file) != 1)
+                break;
+
+            ok = fread(&count, sizeof(count), 1, file) == 1;
+
+            for (unsigned int j = 0; ok && j < count; j++) {
+                unsigned int length;
+                ok = fread(&length, sizeof(length), 1, file) == 1 && length < (1U << 30);
+                if (ok) {
+                    std::string text(length, '\0');
+                    ok = fread(&text[0], 1, length, file) == length;
+                    record.results.push_back(text);
+                }
+            }
+
+            if (ok)
+                _records.push_back(record);
+
+        }
+
+        // A damaged file is ignored and replaced
+        if (!ok) {
+            _records.clear();
+            _changed = true;
+        }
+
+        fclose(file);
+
+    }
+
+    std::string _directory;
+
+    std::string _identity;
+
+    std::string _file;
+
+    std::vector<Record> _records;
+
+    size_t _position = 0;
+
+    unsigned long long _chain = _seed;
+
+    bool _active = false;
+
+    bool _changed = false;
+
+};
+
+#endif
+
+template<typename T>
+class VOTManager {
+
+public:
+
+    VOTManager() {
+        // Shared setup of the tracker overlaps with the handshake, it is waited for before the first tracker is created
+        if constexpr (vot_tracker_prepares<T>::value)
+            _startup.start([]() { T::prepare(); });
+        _vot = new VOT(VOTFormatTraits<VOT_DEFAULT_FORMAT>::trax, vot_tracker_channels<T>::value, _VOT_FLAGS, vot_tracker_images<T>::value);
+        // Trackers are recreated in the same process when the client reinitializes them
+        _vot->accept_reset();
+        // Trackers for objects that start later are created on their first frame
+        _vot->accept_objects();
+    }
+
+#ifdef VOT_OPENCV
+    VOTManager(const VOTFrameLoader& loader) : VOTManager() {
+        _loader = loader;
+    }
+#endif
+
+    ~VOTManager() {
+        if (_vot)
+            delete _vot;
+    }
+
+    /**
+     * Sets the time budget of a frame in seconds, measured from the arrival
+     * of the frame. Objects that do not fit into it are reported as an
+     * extrapolation of their motion (see VOTBudget). Disabled by default.
+     */
+    void budget(double seconds) {
+        _budget.set(seconds);
+    }
+
+    /**
+     * Sets the number of threads that the manager splits between objects and
+     * the internal parallelism of OpenCV, by default vot_thread_budget().
+     */
+    void threads(int count) {
+        _threads = std::max(1, count);
+        _plan = 0;
+    }
+
+    /**
+     * Sends the results of each frame from a dedicated thread, see
+     * VOT::async_reply(). Disabled by default.
+     */
+    void async_reply(bool async = true) {
+        _vot->async_reply(async);
+    }
+
+    /**
+     * Declares parameters that change the results of the tracker, for
+     * instance its command line arguments. They are a part of the key of
+     * stored results (see VOTResultCache).
+     */
+    void parameters(const std::string& parameters) {
+        _parameters = parameters;
+    }
+
+    void run() {
+
+#ifndef _WIN32
+        // Results under a time budget depend on timing and are not stored
+        const char* directory = getenv("VOT_RESULT_CACHE");
+        std::string executable = VOTResultCache::executable();
+
+        if (directory && *directory && !executable.empty() && !_budget.enabled())
+            _results.reset(new VOTResultCache(directory, executable + "\n" + typeid(T).name() + "\n" + _parameters));
+#endif
+
+        start(wait());
+
+        for (int frame = 1; ; frame++) {
+
+            _trace.frame(frame);
+
+            const VOTImage& image = wait();
+
+            if (_vot->end())
+                break;
+
+            if (_budget.enabled())
+                _budget.start();
+
+            // A reinitialization replaces all trackers, there is nothing to report for this frame
+            if (_vot->reset()) {
+                start(image);
+                continue;
+            }
+
+            if (replay(image))
+                continue;
+
+            std::vector<VOTRegion> state = step(input(image), _vot->retired(), _vot->added());
+
+#ifndef _WIN32
+            if (_results)
+                _results->store(state);
+#endif
+
+            VOTTrace::Span span(_trace, "report");
+
+            _vot->report(std::move(state));
+
+        }
+
+#ifndef _WIN32
+        if (_results)
+            _results->finish();
+#endif
+
+        release();
+
+    }
+
+private:
+
+    // Creates trackers for the objects of the first frame unless their results are stored
+    void start(const VOTImage& image) {
+
+#ifndef _WIN32
+        _replaying = false;
+
+        if (_results && _results->start(image, _vot->objects())) {
+            release();
+            _replaying = true;
+            _first = image;
+            _objects = _vot->objects();
+            _history.clear();
+            return;
+        }
+#endif
+
+        initialize(input(image), _vot->objects());
+
+    }
+
+    /**
+     * Reports stored results while the frames match a stored run. On the
+     * first frame that does not match the trackers are created and catch up
+     * on the frames that were replayed. Returns true if the frame was
+     * reported.
+     */
+    bool replay(const VOTImage& image) {
+
+#ifndef _WIN32
+        if (!_results)
+            return false;
+
+        std::vector<VOTRegion> added = _vot->added();
+        std::vector<VOTRegion> state;
+
+        // The key is extended also after the trackers catch up, so the following frames are stored
+        bool hit = _results->next(image, added, _vot->retired(), state);
+
+        if (!_replaying)
+            return false;
+
+        if (hit) {
+            _history.push_back({image, added, _vot->retired()});
+            VOTTrace::Span span(_trace, "report");
+            _vot->report(std::move(state));
+            return true;
+        }
+
+        _replaying = false;
+
+        VOTTrace::Span span(_trace, "catch up");
+
+        initialize(input(_first), _objects);
+
+        for (const Replayed& frame : _history)
+            step(input(frame.image), frame.retired, frame.added);
+
+        _history.clear();
+#endif
+
+        return false;
+
+    }
+
+    /**
+     * Updates the trackers with a frame, retired objects are released first
+     * and trackers for added objects are created last. Returns the regions of
+     * all objects.
+     */
+    template <typename I>
+    std::vector<VOTRegion> step(const I& data, const std::vector<int>& retired, const std::vector<VOTRegion>& added) {
+
+        // Finished objects keep their index and are reported as empty
+        for (int i : retired) {
+            if (i >= 0 && i < (int) _trackers.size() && _trackers[i]) {
+                delete _trackers[i];
+                _trackers[i] = NULL;
+            }
+        }
+
+        std::vector<VOTRegion> state(_trackers.size(), empty());
+
+        int workers = plan();
+
+        if (workers > 1) {
+
+            // Participants take objects in turns, results are stored in place
+            std::atomic<int> next(0);
+
+            _workers.run(workers, [&](int) {
+                for (int i = next++; i < (int) _trackers.size(); i = next++) {
+                    if (!_trackers[i])
+                        continue;
+                    VOTTrace::Span span(_trace, "update", i);
+                    state[i] = _trackers[i]->update(data);
+                }
+            });
+
+        }
+
+        // Under a budget objects are updated in the order of priority
+        for (int i : workers > 1 ? std::vector<int>() : _budget.order((int) _trackers.size())) {
+
+            if (!_trackers[i])
+                continue;
+
+            if (!_budget.admit(i)) {
+                VOTTrace::Span span(_trace, "extrapolate", i);
+                state[i] = _budget.skip(i);
+                if constexpr (vot_tracker_skips<T>::value)
+                    _trackers[i]->skip();
+                continue;
+            }
+
+            VOTTrace::Span span(_trace, "update", i);
+
+            if (!_budget.enabled()) {
+                state[i] = _trackers[i]->update(data);
+                continue;
+            }
+
+            VOTBudget::clock::time_point begin = VOTBudget::clock::now();
+            state[i] = _trackers[i]->update(data);
+            _budget.measured(i, state[i], std::chrono::duration<double>(VOTBudget::clock::now() - begin).count(), confidence(_trackers[i]));
+
+        }
+
+        if (!added.empty())
+            _startup.wait();
+
+        // New objects are reported with their initial region on their first frame
+        for (const VOTRegion& object : added) {
+            VOTTrace::Span span(_trace, "initialize", (int) _trackers.size());
+            if (_budget.enabled())
+                _budget.reset((int) _trackers.size(), object);
+            _trackers.push_back(new T(data, object));
+            state.push_back(object);
+        }
+
+        return state;
+
+    }
+
+    template <typename I>
+    void initialize(const I& data, const std::vector<VOTRegion>& objects) {
+
+        release();
+
+        _budget.clear();
+
+        _startup.wait();
+
+        for (int i = 0; i < objects.size(); i++) {
+            VOTTrace::Span span(_trace, "initialize", i);
+            if (_budget.enabled())
+                _budget.reset(i, objects[i]);
+            _trackers.push_back(new T(data, objects[i]));
+        }
+
+    }
+
+    void release() {
+
+        for (int i = 0; i < _trackers.size(); i++) {
+            delete _trackers[i];
+        }
+
+        _trackers.clear();
+
+    }
+
+    static VOTRegion empty() {
+
+        trax_region* region = trax_region_create_rectangle(0, 0, 0, 0);
+        VOTRegion result = VOTRegion::from_trax(region);
+        trax_region_release(&region);
+
+        return result;
+
+    }
+
+    /**
+     * Splits the thread budget for the current frame and returns the number
+     * of objects that are updated concurrently. Objects are spread over the
+     * threads while there are enough of them, the remaining threads are left
+     * to OpenCV within each object. Trackers that are not parallel and frames
+     * under a time budget, where objects are admitted one after another, are
+     * updated serially with all threads given to OpenCV.
+     */
+    int plan() {
+
+        int workers = 1;
+
+        if constexpr (vot_tracker_parallel<T>::value) {
+            if (!_budget.enabled())
+                workers = std::max(1, std::min((int) std::count_if(_trackers.begin(), _trackers.end(), [](T* tracker) { return tracker != NULL; }), _threads));
+        }
+
+        if (workers != _plan) {
+            _plan = workers;
+#ifdef VOT_OPENCV
+            cv::setNumThreads(std::max(1, _threads / workers));
+#endif
+            _workers.pin(workers > 1 ? _threads / workers : 0);
+        }
+
+        return workers;
+
+    }
+
+    static float confidence(const T* tracker) {
+        if constexpr (vot_tracker_confidence<T>::value)
+            return tracker->confidence();
+        else
+            return 1;
+    }
+
+    const VOTImage& wait() {
+        VOTTrace::Span span(_trace, "wait");
+        return _vot->image();
+    }
+
+    // Decodes the requested channels if the tracker works with decoded frames
+    decltype(auto) input(const VOTImage& image) {
+#ifdef VOT_OPENCV
+        if constexpr (vot_tracker_decodes<T>::value) {
+            VOTTrace::Span span(_trace, "decode");
+            return static_cast<const VOTFrame&>(_loader.load(image, vot_tracker_channels<T>::value));
+        } else {
+            return static_cast<const VOTImage&>(image);
+        }
+#else
+        return static_cast<const VOTImage&>(image);
+#endif
+    }
+
+    VOT* _vot = NULL;
+
+    std::vector<T*> _trackers;
+
+    VOTTrace _trace;
+
+    VOTBudget _budget;
+
+    int _threads = vot_thread_budget();
+
+    // Number of concurrent objects that the threads are currently set up for
+    int _plan = 0;
+
+    VOTWorkers _workers;
+
+    VOTStartup _startup;
+
+    std::string _parameters;
+
+#ifndef _WIN32
+    // Frames that were reported from stored results, kept until the trackers have to catch up
+    struct Replayed {
+        VOTImage image;
+        std::vector<VOTRegion> added;
+        std::vector<int> retired;
+    };
+
+    std::unique_ptr<VOTResultCache> _results;
+
+    bool _replaying = false;
+
+    VOTImage _first;
+
+    std::vector<VOTRegion> _objects;
+
+    std::vector<Replayed> _history;
+#endif
+
+#ifdef VOT_OPENCV
+    VOTFrameLoader _loader;
+#endif
+
+};
+
+#endif
+
+#endif
+
+#if !defined(VOT_LIBRARY) || defined(VOT_IMPLEMENTATION)
+
+/**
+ * Record and replay state of the process, shared by all handles.
+ */
+typedef struct _vot_session {
+    vot_log* record;
+    vot_log* replay;
+    double start;
+} _vot_session;
+
+VOT_API _vot_session* _vot_session_state() {
+
+    static _vot_session session = {NULL, NULL, 0};
+
+    return &session;
+
+}
+
+VOT_INLINE double _vot_clock() {
+
+#ifdef TIME_UTC
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+
+}
+
+// Numbers in the log are stored as 32 bit little endian integers, data as its length followed by the bytes
+
+VOT_INLINE void _vot_log_put(vot_log* log, unsigned int value) {
+
+    unsigned char bytes[4] = {(unsigned char) value, (unsigned char) (value >> 8), (unsigned char) (value >> 16), (unsigned char) (value >> 24)};
+
+    fwrite(bytes, 1, 4, log->file);
+
+}
+
+VOT_INLINE int _vot_log_get(vot_log* log, unsigned int* value) {
+
+    unsigned char bytes[4];
+
+    if (fread(bytes, 1, 4, log->file) != 4)
+        return 0;
+
+    *value = (unsigned int) bytes[0] | (unsigned int) bytes[1] << 8 | (unsigned int) bytes[2] << 16 | (unsigned int) bytes[3] << 24;
+
+    return 1;
+
+}
+
+VOT_INLINE void _vot_log_put_data(vot_log* log, const char* data, size_t length) {
+
+    _vot_log_put(log, (unsigned int) length);
+    fwrite(data, 1, length, log->file);
+
+}
+
+/**
+ * Reads data written by _vot_log_put_data, the returned buffer is zero
+ * terminated and has to be freed. Returns NULL if the log is truncated.
+ */
+VOT_INLINE char* _vot_log_get_data(vot_log* log, unsigned int* length) {
+
+    char* data;
+
+    if (!_vot_log_get(log, length))
+        return NULL;
+
+    data = (char*) malloc(*length + 1);
+
+    if (!data)
+        return NULL;
+
+    if (fread(data, 1, *length, log->file) != *length) {
+        free(data);
+        return NULL;
+    }
+
+    data[*length] = 0;
+
+    return data;
+
+}
+
+VOT_INLINE void _vot_log_put_property(const char* key, const char* value, const void* object) {
+
+    vot_log* log = (vot_log*) object;
+
+    _vot_log_put_data(log, key, strlen(key));
+    _vot_log_put_data(log, value, strlen(value));
+
+}
+
+VOT_INLINE void _vot_log_put_properties(vot_log* log, const trax_properties* properties) {
+
+    if (!properties) {
+        _vot_log_put(log, 0);
+        return;
+    }
+
+    _vot_log_put(log, (unsigned int) trax_properties_count(properties));
+    trax_properties_enumerate(properties, _vot_log_put_property, log);
+
+}
+
+VOT_INLINE int _vot_log_get_properties(vot_log* log, trax_properties* properties) {
+
+    unsigned int count, i, length;
+
+    if (!_vot_log_get(log, &count))
+        return 0;
+
+    for (i = 0; i < count; i++) {
+
+        char* key = _vot_log_get_data(log, &length);
+        char* value = key ? _vot_log_get_data(log, &length) : NULL;
+
+        if (value && properties)
+            trax_properties_set(properties, key, value);
+
+        free(key);
+
+        if (!value)
+            return 0;
+
+        free(value);
+
+    }
+
+    return 1;
+
+}
+
+VOT_INLINE int _vot_memory_depth(int format) {
+
+    return format == TRAX_IMAGE_MEMORY_RGB ? 3 : (format == TRAX_IMAGE_MEMORY_GRAY16 ? 2 : 1);
+
+}
+
+/**
+ * Opens a session log for writing (the header is written with the given
+ * channels and metadata flags) or for reading (channels and flags are read
+ * from the header). Returns NULL if the file can not be opened or is not a
+ * session log.
+ */
+VOT_API vot_log* vot_log_open(const char* filename, int write, int channels, int flags) {
+
+    char magic[4];
+    unsigned int version = 0, value = 0;
+    vot_log* log = (vot_log*) malloc(sizeof(vot_log));
+
+    if (!log)
+        return NULL;
+
+    log->file = fopen(filename, write ? "wb" : "rb");
+    log->write = write;
+    log->channels = channels;
+    log->flags = flags;
+
+    if (!log->file) {
+        free(log);
+        return NULL;
+    }
+
+    if (write) {
+        fwrite("VOTL", 1, 4, log->file);
+        _vot_log_put(log, 1);
+        _vot_log_put(log, (unsigned int) channels);
+        _vot_log_put(log, (unsigned int) flags);
+        return log;
+    }
+
+    if (fread(magic, 1, 4, log->file) != 4 || memcmp(magic, "VOTL", 4) != 0 || !_vot_log_get(log, &version) || version != 1) {
+        vot_log_close(&log);
+        return NULL;
+    }
+
+    if (!_vot_log_get(log, &value)) {
+        vot_log_close(&log);
+        return NULL;
+    }
+
+    log->channels = (int) value;
+
+    if (!_vot_log_get(log, &value)) {
+        vot_log_close(&log);
+        return NULL;
+    }
+
+    log->flags = (int) value;
+
+    return log;
+
+}
+
+VOT_API void vot_log_close(vot_log** log) {
+
+    if (!*log)
+        return;
+
+    fclose((*log)->file);
+    free(*log);
+    *log = NULL;
+
+}
+
+/**
+ * Appends a record to the log: the message type (TRAX_INITIALIZE and
+ * TRAX_FRAME for requests, TRAX_STATE for replies, TRAX_QUIT at the end),
+ * its time in seconds since the start of the session, images, objects and
+ * properties. Any of them can be NULL.
+ */
+VOT_API void vot_log_write(vot_log* log, int type, const trax_image_list* images, trax_object_list* objects, const trax_properties* properties, double time) {
+
+    int i, row, count = 0;
+    unsigned long long microseconds = (unsigned long long) (time > 0 ? time * 1e6 : 0);
+
+    fputc(type, log->file);
+    _vot_log_put(log, (unsigned int) (microseconds & 0xFFFFFFFF));
+    _vot_log_put(log, (unsigned int) (microseconds >> 32));
+
+    for (i = 0; i < TRAX_CHANNELS; i++) {
+        if (images && trax_image_list_get(images, TRAX_CHANNEL_ID(i)))
+            count++;
+    }
+
+    _vot_log_put(log, (unsigned int) count);
+
+    for (i = 0; i < TRAX_CHANNELS && count > 0; i++) {
+
+        trax_image* image = trax_image_list_get(images, TRAX_CHANNEL_ID(i));
+
+        if (!image)
+            continue;
+
+        _vot_log_put(log, (unsigned int) TRAX_CHANNEL_ID(i));
+        _vot_log_put(log, (unsigned int) trax_image_get_type(image));
+
+        switch (trax_image_get_type(image)) {
+        case TRAX_IMAGE_PATH: {
+            const char* path = trax_image_get_path(image);
+            _vot_log_put_data(log, path, strlen(path));
+            break;
+        }
+        case TRAX_IMAGE_URL: {
+            const char* url = trax_image_get_url(image);
+            _vot_log_put_data(log, url, strlen(url));
+            break;
+        }
+        case TRAX_IMAGE_BUFFER: {
+            int length, format;
+            const char* data = trax_image_get_buffer(image, &length, &format);
+            _vot_log_put_data(log, data, (size_t) length);
+            break;
+        }
+        case TRAX_IMAGE_MEMORY: {
+            int width, height, format;
+            trax_image_get_memory_header(image, &width, &height, &format);
+            _vot_log_put(log, (unsigned int) width);
+            _vot_log_put(log, (unsigned int) height);
+            _vot_log_put(log, (unsigned int) format);
+            for (row = 0; row < height; row++)
+                fwrite(trax_image_get_memory_row(image, row), 1, (size_t) width * _vot_memory_depth(format), log->file);
+            break;
+        }
+        }
+
+    }
+
+    count = objects ? trax_object_list_count(objects) : 0;
+
+    _vot_log_put(log, (unsigned int) count);
+
+    for (i = 0; i < count; i++) {
+        char* region = trax_region_encode(trax_object_list_get(objects, i));
+        _vot_log_put_data(log, region, strlen(region));
+        free(region);
+        _vot_log_put_properties(log, trax_object_list_properties(objects, i));
+    }
+
+    _vot_log_put_properties(log, properties);
+
+    fflush(log->file);
+
+}
+
+/**
+ * Reads the next record of the log. Images and objects are created if the
+ * record contains any (NULL otherwise) and are owned by the caller,
+ * properties are added to the given ones if not NULL. Returns the type of the
+ * record, TRAX_QUIT at the end of the log and TRAX_ERROR if it is truncated.
+ */
+VOT_API int vot_log_read(vot_log* log, trax_image_list** images, trax_object_list** objects, trax_properties* properties, double* time) {
+
+    unsigned int low, high, count, i, length;
+    int row, type = fgetc(log->file);
+
+    *images = NULL;
+    *objects = NULL;
+
+    if (type == EOF)
+        return TRAX_QUIT;
+
+    if (!_vot_log_get(log, &low) || !_vot_log_get(log, &high) || !_vot_log_get(log, &count))
+        return TRAX_ERROR;
+
+    if (time)
+        *time = (double) ((unsigned long long) high << 32 | low) * 1e-6;
+
+    if (count > 0)
+        *images = trax_image_list_create();
+
+    for (i = 0; i < count; i++) {
+
+        unsigned int channel, kind;
+        trax_image* image = NULL;
+
+        if (!_vot_log_get(log, &channel) || !_vot_log_get(log, &kind))
+            goto error;
+
+        if (kind == TRAX_IMAGE_MEMORY) {
+            unsigned int width, height, format;
+            if (!_vot_log_get(log, &width) || !_vot_log_get(log, &height) || !_vot_log_get(log, &format))
+                goto error;
+            image = trax_image_create_memory((int) width, (int) height, (int) format);
+            for (row = 0; row < (int) height; row++) {
+                if (fread(trax_image_write_memory_row(image, row), 1, (size_t) width * _vot_memory_depth((int) format), log->file) != (size_t) width * _vot_memory_depth((int) format)) {
+                    trax_image_release(&image);
+                    goto error;
+                }
+            }
+        } else {
+            char* data = _vot_log_get_data(log, &length);
+            if (!data)
+                goto error;
+            if (kind == TRAX_IMAGE_PATH)
+                image = trax_image_create_path(data);
+            else if (kind == TRAX_IMAGE_URL)
+                image = trax_image_create_url(data);
+            else if (kind == TRAX_IMAGE_BUFFER)
+                image = trax_image_create_buffer((int) length, data);
+            free(data);
+        }
+
+        if (image)
+            trax_image_list_set(*images, image, (int) channel);
+
+    }
+
+    if (!_vot_log_get(log, &count))
+        goto error;
+
+    if (count > 0)
+        *objects = trax_object_list_create((int) count);
+
+    for (i = 0; i < count; i++) {
+
+        char* data = _vot_log_get_data(log, &length);
+        trax_region* region = data ? trax_region_decode(data) : NULL;
+
+        free(data);
+
+        if (!region)
+            goto error;
+
+        trax_object_list_set(*objects, (int) i, region);
+        trax_region_release(&region);
+
+        if (!_vot_log_get_properties(log, trax_object_list_properties(*objects, (int) i)))
+            goto error;
+
+    }
+
+    if (!_vot_log_get_properties(log, properties))
+        goto error;
+
+    return type;
+
+error:
+
+    if (*images) {
+        trax_image_list_clear(*images);
+        trax_image_list_release(images);
+    }
+
+    if (*objects)
+        trax_object_list_release(objects);
+
+    return TRAX_ERROR;
+
+}
+
+/**
+ * Sets up the TraX server with the given region formats (a combination of
+ * TRAX_REGION_* flags), image formats (TRAX_IMAGE_* flags), channels and
+ * metadata flags. Image paths are always accepted as a fallback. If the
+ * VOT_REPLAY environment variable is set the requests are read from that
+ * session log instead, the handle is then only a placeholder that keeps the
+ * metadata. If VOT_RECORD is set the session is recorded to that file.
+ */
+VOT_API trax_handle* _vot_server_setup(int region_formats, int image_formats, int channels, int flags) {
+
+    _vot_session* session = _vot_session_state();
+    const char* replay = getenv("VOT_REPLAY");
+    const char* record = getenv("VOT_RECORD");
+    trax_handle* handle;
 
-#endif
-#if _VOT_REGION == 3
+    trax_metadata* metadata = trax_metadata_create(region_formats, image_formats | TRAX_IMAGE_PATH, channels, NULL, NULL, NULL, flags);
 
-    VOTRegion(const cv::Mat& mask) {
-        assert(!mask.empty() && mask.channels() == 2 && mask.elemSize() == 1);
+    trax_properties_set(metadata->custom, "vot", VOT_WRAPPER);
 
-        _region = vot_region_create(mask.cols, mask.rows);
-        set(mask);
-    }
+    session->start = _vot_clock();
 
-    void set(const cv::Mat& mask) {
+    if (replay && *replay) {
 
-        assert(!mask.empty() && mask.channels() == 2 && mask.elemSize() == 1);
+        session->replay = vot_log_open(replay, 0, 0, 0);
 
-        if (_region->width != mask.cols || _region->height != mask.rows) {
-            vot_region_release(&(this->_region));
-            _region = vot_region_create(mask.cols, mask.rows);
+        if (!session->replay) {
+            fprintf(stderr, "Unable to read session log %s\n", replay);
+            trax_metadata_release(&metadata);
+            return NULL;
         }
 
-        for (int i = 0; i < mask.rows; i++) {
-            memcpy(&(_region->data[mask.cols * i]), mask.prt(i), _region->width * sizeof(char));
+        if ((session->replay->channels & channels) != channels) {
+            fprintf(stderr, "Session log %s does not contain all channels of the tracker\n", replay);
+            vot_log_close(&session->replay);
+            trax_metadata_release(&metadata);
+            return NULL;
         }
 
-    }
-
-    void get(cv::Mat& mask) const {
+        handle = (trax_handle*) calloc(1, sizeof(trax_handle));
+        handle->metadata = metadata;
 
-	    mask.create(cv::Size(_region->height, _region->width), CV_8UC1);
+    } else {
 
-        memcpy(mask.prt(0), _region->data, _region->height * _region->width * sizeof(char));
+        handle = trax_server_setup(metadata, trax_no_log);
 
-    }
+        trax_metadata_release(&metadata);
 
-    void operator= (cv::Mat& mask) {
-        this->get(mask);
     }
 
-#endif
-#endif
-
-protected:
-
-    vot_region* _region;
-
-};
+    if (handle && record && *record) {
 
-#ifdef VOT_OPENCV
-#if _VOT_REGION == 1 || _VOT_REGION == 2
-void operator<< (VOTRegion &source, const cv::Rect& rectangle) {
-    source.set(rectangle);
-}
+        session->record = vot_log_open(record, 1, channels, flags);
 
-void operator>> (const VOTRegion &source, cv::Rect& rectangle) {
-    source.get(rectangle);
-}
+        if (!session->record)
+            fprintf(stderr, "Unable to record session to %s\n", record);
 
-void operator<< (cv::Rect& rectangle, const VOTRegion &source) {
-    source.get(rectangle);
-}
+    }
 
-void operator>> (const cv::Rect& rectangle, VOTRegion &source) {
-    source.set(rectangle);
-}
-#endif
-#if _VOT_REGION == 3
-void operator<< (VOTRegion &source, const cv::Mat& mask) {
-    source.set(mask);
-}
+    return handle;
 
-void operator>> (const VOTRegion &source, cv::Mat& mask) {
-    source.get(mask);
 }
 
-void operator<< (cv::Mat& mask, const VOTRegion &source) {
-    source.get(mask);
-}
+/**
+ * Reads the next request from the replayed log. Replies stored in the log
+ * are skipped, objects in a format that the tracker does not accept are
+ * converted as the client would do. Images of a type that the tracker does
+ * not accept are an error.
+ */
+VOT_INLINE int _vot_replay_wait(trax_handle* handle, trax_image_list** images, trax_object_list** objects, trax_properties* properties) {
 
-void operator>> (const cv::Mat& mask, VOTRegion &source) {
-    source.set(mask);
-}
+    int i, type;
+    int formats = handle->metadata->format_region;
 
-#endif
-#endif
+    do {
+        type = vot_log_read(_vot_session_state()->replay, images, objects, properties, NULL);
+        if (type == TRAX_STATE && *objects)
+            trax_object_list_release(objects);
+    } while (type == TRAX_STATE);
 
-class VOT {
-public:
-    VOT() {
-        vot_initialize();
-    }
+    if (type != TRAX_INITIALIZE && type != TRAX_FRAME)
+        return type;
 
-    ~VOT() {
-        vot_quit();
-    }
+    for (i = 0; i < TRAX_CHANNELS; i++) {
 
-    #ifdef VOT_MULTI_OBJECT
-    const std::vector<VOTRegion> objects() {
+        trax_image* image = *images ? trax_image_list_get(*images, TRAX_CHANNEL_ID(i)) : NULL;
 
-        std::vector<VOTRegion> wrappers;
-        
-        for (int i = 0; i < VOT_MAX_OBJECTS; i++) {
-            if (_objects[i])
-                wrappers.push_back(VOTRegion(_objects[i]));
-            else break;
+        if (image && !(trax_image_get_type(image) & handle->metadata->format_image)) {
+            fprintf(stderr, "Session log contains images that the tracker does not accept\n");
+            trax_image_list_clear(*images);
+            trax_image_list_release(images);
+            if (*objects)
+                trax_object_list_release(objects);
+            return TRAX_ERROR;
         }
 
-        return wrappers;
     }
 
-    void report(const std::vector<VOTRegion>& objects) {
+    for (i = 0; *objects && i < trax_object_list_count(*objects); i++) {
 
-        vot_objects unwrapped = new vot_region*[objects.size()+1];
+        trax_region* region = trax_object_list_get(*objects, i);
 
-        for (int i = 0; i < objects.size(); i++) {
-            unwrapped[i] = objects[i]._region;
+        if (!(trax_region_get_type(region) & formats)) {
+            region = trax_region_convert(region, (formats & TRAX_REGION_RECTANGLE) ? TRAX_REGION_RECTANGLE :
+                ((formats & TRAX_REGION_POLYGON) ? TRAX_REGION_POLYGON : TRAX_REGION_MASK));
+            trax_object_list_set(*objects, i, region);
+            trax_region_release(&region);
         }
 
-        unwrapped[objects.size()] = NULL;
-
-        vot_report(unwrapped);
-    }
-
-    #else
-    const VOTRegion region() {
-        return VOTRegion(_objects[0]);
-    }
-
-    void report(const VOTRegion& region, float confidence = 1) {
-        vot_report2(region._region, confidence);
     }
-    #endif
 
-#if defined(VOT_RGBD) || defined(VOT_RGBT)
-    const VOTImage frame() {
-        return image();
-    }
-#else
-    const string frame() {
-        return image().color;
-    }
-#endif
+    return type;
 
-    const VOTImage image() {
+}
 
-        const vot_image* result = vot_frame();
-        VOTImage wrapper;
+/**
+ * Waits for a request of the client or reads it from the replayed log, the
+ * request is recorded if a session is recorded.
+ */
+VOT_API int _vot_server_wait(trax_handle* handle, trax_image_list** images, trax_object_list** objects, trax_properties* properties) {
 
-        if (!result)
-            return wrapper;
+    _vot_session* session = _vot_session_state();
+    trax_properties* request = properties;
+    int response;
 
-#if defined(VOT_RGBD)
-        wrapper.color = string(_image.color);
-        wrapper.depth = string(_image.depth);
-#elif defined(VOT_RGBT)
-        wrapper.color = string(_image.color);
-        wrapper.ir = string(_image.ir);
-#elif defined(VOT_IR)
-        wrapper.ir = string(_image.ir);
-#else
-        wrapper.color = string(_image.color);
-#endif
-        return wrapper;
-    }
+    if (!handle)
+        return TRAX_ERROR;
 
-    bool end() {
-        return vot_end() != 0;
-    }
+    if (!session->record && !session->replay)
+        return trax_server_wait(handle, images, objects, properties);
 
-private:
+    // Properties are recorded even if the caller does not read them
+    if (session->record && !request)
+        request = trax_properties_create();
 
-    void vot_quit();
+    if (session->replay)
+        response = _vot_replay_wait(handle, images, objects, request);
+    else
+        response = trax_server_wait(handle, images, objects, request);
 
-    const vot_image* vot_frame();
+    if (session->record && (response == TRAX_INITIALIZE || response == TRAX_FRAME))
+        vot_log_write(session->record, response, *images, *objects, request, _vot_clock() - session->start);
 
-#ifdef VOT_MULTI_OBJECT
-    void vot_report(vot_objects objects);
-    vot_objects vot_initialize();
-#else
-    vot_region* vot_initialize();
-    void vot_report(vot_region* region);
-    void vot_report2(vot_region* region, float confidence);
-#endif
+    if (request != properties)
+        trax_properties_release(&request);
 
-    int vot_end();
+    return response;
 
-#endif
+}
 
-    // Current position in the sequence
-    int _vot_sequence_position;
-    // Size of the sequence
-    int _vot_sequence_size;
-    // List of image file names
-    char** _vot_sequence;
-    // List of results
-    vot_region** _vot_result;
+/**
+ * Sends the reply to the client, it is recorded if a session is recorded.
+ */
+VOT_API int _vot_server_reply(trax_handle* handle, trax_object_list* objects) {
 
-    trax_handle* _trax_handle = NULL;
+    _vot_session* session = _vot_session_state();
 
-    vot_image _image;
+    if (session->record)
+        vot_log_write(session->record, TRAX_STATE, NULL, objects, NULL, _vot_clock() - session->start);
 
-    vot_region* _objects[VOT_MAX_OBJECTS];
+    if (session->replay)
+        return TRAX_OK;
 
-#if _VOT_REGION == 1
+    return trax_server_reply(handle, objects);
 
-vot_region* _trax_to_region(const trax_region* _trax_region) {
-    vot_region* region = vot_region_create();
-    assert(trax_region_get_type(_trax_region) == TRAX_REGION_RECTANGLE);
-    trax_region_get_rectangle(_trax_region, &(region->x), &(region->y), &(region->width), &(region->height));
-    return region;
-}
-trax_region* _region_to_trax(const vot_region* region) {
-    return trax_region_create_rectangle(region->x, region->y, region->width, region->height);
 }
 
-#endif
-
-#if _VOT_REGION == 2
-
-vot_region* _trax_to_region(const trax_region* _trax_region) {
-    int i;
-    int count = trax_region_get_polygon_count(_trax_region);
-    vot_region* region = vot_region_create(count);
-    for (i = 0; i < count; i++)
-        trax_region_get_polygon_point(_trax_region, i, &(region->x[i]), &(region->y[i]));
-    return region;
-}
-trax_region* _region_to_trax(const vot_region* region) {
-    int i;
-    trax_region* _trax_region = trax_region_create_polygon(region->count);
-    assert(trax_region_get_type(_trax_region) == TRAX_REGION_POLYGON);
-    for (i = 0; i < region->count; i++)
-        trax_region_set_polygon_point(_trax_region, i, region->x[i], region->y[i]);
-    return _trax_region;
-}
-#endif
+/**
+ * Closes the connection (or the replayed log) and the recorded log.
+ */
+VOT_API void _vot_server_cleanup(trax_handle** handle) {
 
-#if _VOT_REGION == 3
+    _vot_session* session = _vot_session_state();
 
-vot_region* _trax_to_region(const trax_region* _trax_region) {
-    int x, y, width, height, i;
-    trax_region_get_mask_header(_trax_region, &x, &y, &width, &height);
-    vot_region* region = vot_region_create(x + width, y + height);
+    if (session->replay) {
+        trax_metadata_release(&(*handle)->metadata);
+        free(*handle);
+        *handle = NULL;
+        vot_log_close(&session->replay);
+    } else {
+        trax_cleanup(handle);
+    }
 
-    for (i = 0; i < height; i++) {
-        memcpy(&(region->data[(width + x) * (i + y) + x]), trax_region_get_mask_row(_trax_region, i), width * sizeof(char));
+    if (session->record) {
+        vot_log_write(session->record, TRAX_QUIT, NULL, NULL, NULL, _vot_clock() - session->start);
+        vot_log_close(&session->record);
     }
 
-    return region;
 }
 
-trax_region* _region_to_trax(const vot_region* region) {
+#ifndef __cplusplus
 
-    trax_region* _trax_region = trax_region_create_mask(0, 0, region->width, region->height);
-    memcpy(trax_region_write_mask_row(_trax_region, 0), region->data, region->width * region->height * sizeof(char));
-    return _trax_region;
+// Current position in the sequence
+static int _vot_sequence_position;
 
-}
-#endif
+static trax_handle* _trax_handle = NULL;
 
+static vot_image _image;
 
-#ifdef __cplusplus
+// Path storage for each channel, reused between frames and grown when needed
+static char* _image_storage[TRAX_CHANNELS];
 
-};
+static size_t _image_capacity[TRAX_CHANNELS];
 
-#ifdef VOT_MULTI_OBJECT
+static vot_region* _objects[VOT_MAX_OBJECTS];
 
-class VOTTracker {
+// Set if the current frame reinitializes the tracker
+static int _vot_reset;
 
-public:
+/**
+ * Copies image paths of all channels from a TraX image list. Returns 0 if
+ * the storage could not be allocated.
+ */
+static int _vot_image_read(vot_image* image, const trax_image_list* _trax_image) {
 
-    VOTTracker(const VOTImage& image, const VOTRegion& region) { }
+    int i;
 
-    virtual VOTRegion update(const VOTImage& image) = 0;
+    for (i = 0; i < TRAX_CHANNELS; i++) {
 
-};
+        trax_image* channel = (_VOT_CHANNELS & TRAX_CHANNEL_ID(i)) ? trax_image_list_get(_trax_image, TRAX_CHANNEL_ID(i)) : NULL;
+        const char* path = channel ? trax_image_get_path(channel) : "";
+        size_t length = strlen(path);
 
-template<typename T>
-class VOTManager {
-    
-public:
+        if (length + 1 > _image_capacity[i]) {
+            size_t capacity = length + 1 > VOT_READ_BUFFER ? length + 1 : VOT_READ_BUFFER;
+            char* storage = (char*) realloc(_image_storage[i], capacity);
+            if (!storage)
+                return 0;
+            _image_storage[i] = storage;
+            _image_capacity[i] = capacity;
+        }
 
-    VOTManager() {
-        _vot = new VOT();
-    }
+        memcpy(_image_storage[i], path, length + 1);
 
-    ~VOTManager() {
-        if (_vot)
-            delete _vot;
     }
 
-    void run() {
+    image->color = _image_storage[TRAX_CHANNEL_INDEX(TRAX_CHANNEL_COLOR)];
+    image->depth = _image_storage[TRAX_CHANNEL_INDEX(TRAX_CHANNEL_DEPTH)];
+    image->ir = _image_storage[TRAX_CHANNEL_INDEX(TRAX_CHANNEL_IR)];
 
-        std::vector<VOTRegion> objects = _vot->objects();
-        VOTImage image = _vot->image();
+    return 1;
 
-        for (int i = 0; i < objects.size(); i++) {
-            _trackers.push_back(new T(image, objects[i]));
-        }
+}
 
-        while (!_vot->end()) {
+/**
+ * Accepts an initialization request: reads the image paths, confirms the
+ * objects to the client and replaces the current objects with them. Releases
+ * the request and returns 0 if the paths could not be stored.
+ */
+static int _vot_accept(trax_image_list* _trax_image, trax_object_list* _trax_objects) {
 
-            VOTImage image = _vot->image();
-            std::vector<VOTRegion> state;
+    int j;
+    int ok = _vot_image_read(&_image, _trax_image);
 
-            for (int i = 0; i < _trackers.size(); i++) {
-                state.push_back(_trackers[i]->update(image));
-            }
+    if (ok) {
 
-            _vot->report(state);
+        _vot_server_reply(_trax_handle, _trax_objects);
 
+        for (j = 0; j < VOT_MAX_OBJECTS; j++) {
+            if (_objects[j])
+                vot_region_release(&(_objects[j]));
+            _objects[j] = NULL;
         }
 
-        for (int i = 0; i < _trackers.size(); i++) {
-            delete _trackers[i];
+        for (j = 0; j < trax_object_list_count(_trax_objects) && j < VOT_MAX_OBJECTS; j++) {
+            trax_region* object = trax_object_list_get(_trax_objects, j);
+            _objects[j] = _trax_to_region(object);
         }
 
     }
 
-private:
-
-    VOT* _vot = NULL;
-
-    std::vector<T*> _trackers;
-
-};
-
-#endif
-
-#endif
+    trax_object_list_release(&_trax_objects);
+    trax_image_list_clear(_trax_image);
+    trax_image_list_release(&_trax_image);
 
-#ifdef __cplusplus
-#  define VOT_PREFIX(FUN) VOT::FUN
-#  define VOT_WRAPPER "cpp"
-#else
-#  define VOT_PREFIX(FUN) FUN
-#  define VOT_WRAPPER "c"
-#endif
+    return ok;
 
+}
 
 /**
  * Reads the input data and initializes all structures. Returns the initial
- * position of the object as specified in the input data. This function should
- * be called at the beginning of the program.
+ * position of the object as specified in the input data or NULL if the
+ * wrapper could not be initialized. This function should be called at the
+ * beginning of the program.
  */
 #ifdef VOT_MULTI_OBJECT
-vot_objects
+VOT_API vot_objects
 #else
-vot_region* 
+VOT_API vot_region*
 #endif
-VOT_PREFIX(vot_initialize)() {
+vot_initialize() {
 
-    int j;
     int flags;
-    FILE *inputfile;
-    FILE *imagesfile;
 
     _vot_sequence_position = 0;
-    _vot_sequence_size = 0;
+    _vot_reset = 0;
     flags = 0;
 
     #ifdef VOT_MULTI_OBJECT
@@ -778,10 +4519,8 @@ VOT_PREFIX(vot_initialize)() {
 
     assert(_trax_handle == NULL);
 
-    trax_configuration config;
     trax_image_list* _trax_image = NULL;
     trax_object_list* _trax_objects = NULL;
-    _trax_handle = NULL;
     int response;
     #if _VOT_REGION == 1
     int region_format = TRAX_REGION_RECTANGLE;
@@ -791,53 +4530,23 @@ VOT_PREFIX(vot_initialize)() {
     int region_format = TRAX_REGION_MASK;
     #endif
 
-    #ifdef VOT_RGBD
-    int channels = TRAX_CHANNEL_COLOR | TRAX_CHANNEL_DEPTH;
-    #elif defined(VOT_IR)
-    int channels = TRAX_CHANNEL_IR;
-    #elif defined(VOT_RGBT)
-    int channels = TRAX_CHANNEL_COLOR | TRAX_CHANNEL_IR;
-    #else
-    int channels = TRAX_CHANNEL_COLOR;
-    #endif
-
-    trax_metadata* metadata = trax_metadata_create(region_format, TRAX_IMAGE_PATH, channels, NULL, NULL, NULL, flags);
-
-    trax_properties_set(metadata->custom, "vot", VOT_WRAPPER);
-
-    _trax_handle = trax_server_setup(metadata, trax_no_log);
+    _trax_handle = _vot_server_setup(region_format, TRAX_IMAGE_PATH, _VOT_CHANNELS, flags);
 
-    trax_metadata_release(&metadata);
+    // The reason was printed by the setup, the tracker can not run without a session
+    if (!_trax_handle)
+        exit(EXIT_FAILURE);
 
-    response = trax_server_wait(_trax_handle, &_trax_image, &_trax_objects, NULL);
+    response = _vot_server_wait(_trax_handle, &_trax_image, &_trax_objects, NULL);
 
     assert(response == TRAX_INITIALIZE);
 
-#if defined(VOT_RGBD)
-        strcpy(_image.color, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_COLOR)));
-        strcpy(_image.depth, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_DEPTH)));
-#elif defined(VOT_RGBT)
-        strcpy(_image.color, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_COLOR)));
-        strcpy(_image.ir, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_IR)));
-#elif defined(VOT_IR)
-        strcpy(_image.ir, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_IR)));
-#else
-        strcpy(_image.color, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_COLOR)));
-#endif
-
-    trax_server_reply(_trax_handle, _trax_objects);
-
     memset(_objects, 0, sizeof(vot_region*) * VOT_MAX_OBJECTS);
 
-    for (j = 0; j < trax_object_list_count(_trax_objects); j++) {
-        trax_region* object = trax_object_list_get(_trax_objects, j);
-        _objects[j] = _trax_to_region(object);
+    if (!_vot_accept(_trax_image, _trax_objects)) {
+        vot_quit();
+        return NULL;
     }
 
-    trax_object_list_release(&_trax_objects);
-    trax_image_list_clear(_trax_image);
-    trax_image_list_release(&_trax_image);
-
     #ifdef VOT_MULTI_OBJECT
         return _objects;
     #else
@@ -849,11 +4558,11 @@ VOT_PREFIX(vot_initialize)() {
  * Stores results to the result file and frees memory. This function should be
  * called at the end of the tracking program.
  */
-void VOT_PREFIX(vot_quit)() {
+VOT_API void vot_quit() {
     int i;
 
     if (_trax_handle) {
-        trax_cleanup(&_trax_handle);
+        _vot_server_cleanup(&_trax_handle);
 
         for (i = 0; i < VOT_MAX_OBJECTS; i++) {
             if (_objects[i]) {
@@ -862,6 +4571,12 @@ void VOT_PREFIX(vot_quit)() {
             }
         }
 
+        for (i = 0; i < TRAX_CHANNELS; i++) {
+            free(_image_storage[i]);
+            _image_storage[i] = NULL;
+            _image_capacity[i] = 0;
+        }
+
         return;
     }
 
@@ -871,7 +4586,7 @@ void VOT_PREFIX(vot_quit)() {
  * Returns the file name of the current frame. This function does not advance
  * the current position.
  */
-const vot_image* VOT_PREFIX(vot_frame)() {
+VOT_API const vot_image* vot_frame() {
 
     assert (_trax_handle);
 
@@ -884,28 +4599,33 @@ const vot_image* VOT_PREFIX(vot_frame)() {
         return &_image;
     }
 
-    response = trax_server_wait(_trax_handle, &_trax_image, &_trax_objects, NULL);
+    response = _vot_server_wait(_trax_handle, &_trax_image, &_trax_objects, NULL);
+
+    _vot_reset = 0;
+
+    if (response == TRAX_INITIALIZE && _VOT_REINITIALIZE) {
+        if (!_vot_accept(_trax_image, _trax_objects)) {
+            vot_quit();
+            return NULL;
+        }
+        _vot_reset = 1;
+        return &_image;
+    }
 
-    assert(_trax_objects == NULL || trax_object_list_count(_trax_objects) == 0);
+    // Objects can only be given with a frame as a reinitialization
+    assert(response != TRAX_FRAME || _trax_objects == NULL || trax_object_list_count(_trax_objects) == 0);
 
     trax_object_list_release(&_trax_objects);
 
-    if (response != TRAX_FRAME) {
+    if (response != TRAX_FRAME || !_vot_image_read(&_image, _trax_image)) {
+        if (_trax_image) {
+            trax_image_list_clear(_trax_image);
+            trax_image_list_release(&_trax_image);
+        }
         vot_quit();
         return NULL;
     }
 
-#if defined(VOT_RGBD)
-    strcpy(_image.color, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_COLOR)));
-    strcpy(_image.depth, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_DEPTH)));
-#elif defined(VOT_RGBT)
-    strcpy(_image.color, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_COLOR)));
-    strcpy(_image.ir, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_IR)));
-#elif defined(VOT_IR)
-    strcpy(_image.ir, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_IR)));
-#else
-    strcpy(_image.color, trax_image_get_path(trax_image_list_get(_trax_image, TRAX_CHANNEL_COLOR)));
-#endif
     trax_image_list_clear(_trax_image);
     trax_image_list_release(&_trax_image);
 
@@ -919,7 +4639,7 @@ const vot_image* VOT_PREFIX(vot_frame)() {
  */
 #ifdef VOT_MULTI_OBJECT
 
-void VOT_PREFIX(vot_report)(vot_objects objects) {
+VOT_API void vot_report(vot_objects objects) {
 
     int i;
 
@@ -939,14 +4659,14 @@ void VOT_PREFIX(vot_report)(vot_objects objects) {
         trax_region_release(&_trax_region);
     }
 
-    trax_server_reply(_trax_handle, _objects);
+    _vot_server_reply(_trax_handle, _objects);
     trax_object_list_release(&_objects);
 
 }
 
 #else
 
-void VOT_PREFIX(vot_report)(vot_region* region) {
+VOT_API void vot_report(vot_region* region) {
 
     assert (_trax_handle);
 
@@ -955,13 +4675,13 @@ void VOT_PREFIX(vot_report)(vot_region* region) {
     trax_object_list_set(_objects, 0, _trax_region);
     trax_region_release(&_trax_region);
 
-    trax_server_reply(_trax_handle, _objects);
+    _vot_server_reply(_trax_handle, _objects);
     trax_object_list_release(&_objects);
 
 }
 
 
-void VOT_PREFIX(vot_report2)(vot_region* region, float confidence) {
+VOT_API void vot_report2(vot_region* region, float confidence) {
 
     assert (_trax_handle);
 
@@ -970,18 +4690,93 @@ void VOT_PREFIX(vot_report2)(vot_region* region, float confidence) {
     trax_object_list_set(_objects, 0, _trax_region);
     trax_properties_set_float(trax_object_list_properties(_objects, 0), "confidence", confidence);
     trax_region_release(&_trax_region);
-    trax_server_reply(_trax_handle, _objects);
+    _vot_server_reply(_trax_handle, _objects);
     trax_object_list_release(&_objects);
 
 }
 
 #endif
 
-int VOT_PREFIX(vot_end)() {
+VOT_API int vot_end() {
 
     return _trax_handle == NULL;
 
 }
 
+/**
+ * Returns the new objects if the client reinitialized the tracker on the
+ * current frame (only with VOT_REINITIALIZE), NULL otherwise. The tracker is
+ * reinitialized on this frame and does not report for it. Objects are owned
+ * by the wrapper and are valid until the next reinitialization.
+ */
+#ifdef VOT_MULTI_OBJECT
+VOT_API vot_objects vot_reset() {
+
+    return _vot_reset ? _objects : NULL;
+
+}
+#else
+VOT_API vot_region* vot_reset() {
+
+    return _vot_reset ? _objects[0] : NULL;
+
+}
+#endif
+
+#else
+
+/**
+ * Reads the input data and initializes all structures. This function is
+ * called by the constructor.
+ */
+VOT_API void VOT::vot_initialize(int formats, int channels, int flags, int images) {
+
+    assert(_trax_handle == NULL);
+
+    trax_image_list* _trax_image = NULL;
+    trax_object_list* _trax_objects = NULL;
+
+    _channels = channels;
+
+    _trax_handle = _vot_server_setup(formats, images, channels, flags);
+
+    // The reason was printed by the setup, the tracker can not run without a session
+    if (!_trax_handle)
+        exit(EXIT_FAILURE);
+
+    int response = _vot_server_wait(_trax_handle, &_trax_image, &_trax_objects, NULL);
+
+    assert(response == TRAX_INITIALIZE);
+
+    vot_accept(_trax_image, _trax_objects);
+
+}
+
+/**
+ * Closes the connection and frees memory.
+ */
+VOT_API void VOT::vot_quit() {
+
+    _replier.stop();
+
+    if (_trax_handle) {
+        _vot_server_cleanup(&_trax_handle);
+    }
+
+    if (_objects) {
+        trax_object_list_release(&_objects);
+    }
+
+    if (_added) {
+        trax_object_list_release(&_added);
+    }
+
+    vot_release_image();
+
+}
+
+#endif
+
 #endif
 
+#endif
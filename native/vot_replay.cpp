@@ -0,0 +1,336 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * Replay driver for session logs recorded by the wrapper (VOT_RECORD). The
+ * tracker command is run with VOT_REPLAY set to the log, so it reads the
+ * requests from the log instead of a client and runs as fast as it can. Its
+ * replies are recorded to a second log and compared with the recorded ones,
+ * the driver reports the time and throughput of each run and fails if the
+ * replies differ. Works for trackers that use vot.h or vot.py.
+ *
+ * Usage: vot_replay [-r runs] [-t tolerance] [-o output] session.log command [arguments ...]
+ *
+ * Copyright (c) 2023, VOT Initiative
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the FreeBSD Project.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "vot.h"
+
+/**
+ * Replies of a session log, each one as a list of encoded regions.
+ */
+struct Replies {
+    std::vector<std::vector<std::string>> regions;
+    std::vector<double> times;
+    bool complete = false;
+};
+
+static bool load(const char* filename, Replies& replies) {
+
+    vot_log* log = vot_log_open(filename, 0, 0, 0);
+
+    if (!log)
+        return false;
+
+    while (true) {
+
+        trax_image_list* images = NULL;
+        trax_object_list* objects = NULL;
+        double time = 0;
+
+        int type = vot_log_read(log, &images, &objects, NULL, &time);
+
+        if (type == TRAX_STATE) {
+            std::vector<std::string> regions;
+            for (int i = 0; i < trax_object_list_count(objects); i++) {
+                char* region = trax_region_encode(trax_object_list_get(objects, i));
+                regions.push_back(region);
+                free(region);
+            }
+            replies.regions.push_back(regions);
+            replies.times.push_back(time);
+        }
+
+        if (images) {
+            trax_image_list_clear(images);
+            trax_image_list_release(&images);
+        }
+
+        if (objects)
+            trax_object_list_release(&objects);
+
+        if (type == TRAX_QUIT) {
+            // A log of a session that ended normally finishes with a quit record, a truncated one ends without it
+            replies.complete = true;
+            break;
+        }
+
+        if (type == TRAX_ERROR)
+            break;
+
+    }
+
+    vot_log_close(&log);
+
+    return true;
+
+}
+
+/**
+ * Mask element at the given image position.
+ */
+static bool mask_at(const trax_region* mask, int x, int y) {
+
+    int mx, my, width, height;
+
+    trax_region_get_mask_header(mask, &mx, &my, &width, &height);
+
+    if (x < mx || y < my || x >= mx + width || y >= my + height)
+        return false;
+
+    return trax_region_get_mask_row(mask, y - my)[x - mx] != 0;
+
+}
+
+/**
+ * Compares two encoded regions. The text of the same region differs between
+ * wrappers (number formatting, bounds of masks), so regions that are not
+ * equal as text are decoded and their coordinates are compared up to the
+ * given tolerance, masks have to cover the same pixels.
+ */
+static bool same(const std::string& expected, const std::string& actual, double tolerance) {
+
+    if (expected == actual)
+        return true;
+
+    trax_region* a = trax_region_decode(expected.c_str());
+    trax_region* b = trax_region_decode(actual.c_str());
+
+    bool result = a && b && trax_region_get_type(a) == trax_region_get_type(b);
+
+    if (result && trax_region_get_type(a) == TRAX_REGION_MASK) {
+
+        trax_bounds ba = trax_region_bounds(a), bb = trax_region_bounds(b);
+
+        for (int y = (int) std::min(ba.top, bb.top); result && y <= (int) std::max(ba.bottom, bb.bottom); y++) {
+            for (int x = (int) std::min(ba.left, bb.left); result && x <= (int) std::max(ba.right, bb.right); x++) {
+                result = mask_at(a, x, y) == mask_at(b, x, y);
+            }
+        }
+
+    } else if (result && trax_region_get_type(a) == TRAX_REGION_POLYGON) {
+
+        result = trax_region_get_polygon_count(a) == trax_region_get_polygon_count(b);
+
+        for (int i = 0; result && i < trax_region_get_polygon_count(a); i++) {
+            float ax, ay, bx, by;
+            trax_region_get_polygon_point(a, i, &ax, &ay);
+            trax_region_get_polygon_point(b, i, &bx, &by);
+            result = fabs(ax - bx) <= tolerance && fabs(ay - by) <= tolerance;
+        }
+
+    } else if (result && trax_region_get_type(a) == TRAX_REGION_RECTANGLE) {
+
+        float ax, ay, aw, ah, bx, by, bw, bh;
+        trax_region_get_rectangle(a, &ax, &ay, &aw, &ah);
+        trax_region_get_rectangle(b, &bx, &by, &bw, &bh);
+        result = fabs(ax - bx) <= tolerance && fabs(ay - by) <= tolerance && fabs(aw - bw) <= tolerance && fabs(ah - bh) <= tolerance;
+
+    } else if (result && trax_region_get_type(a) == TRAX_REGION_SPECIAL) {
+
+        result = trax_region_get_special(a) == trax_region_get_special(b);
+
+    }
+
+    if (a)
+        trax_region_release(&a);
+    if (b)
+        trax_region_release(&b);
+
+    return result;
+
+}
+
+/**
+ * Runs the tracker with the given log replayed and its replies recorded,
+ * returns its exit status.
+ */
+static int run(char** command, const char* session, const char* output) {
+
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        setenv("VOT_REPLAY", session, 1);
+        setenv("VOT_RECORD", output, 1);
+        execvp(command[0], command);
+        perror(command[0]);
+        _exit(127);
+    }
+
+    int status = 0;
+
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+}
+
+static void usage() {
+
+    fprintf(stderr, "Usage: vot_replay [-r runs] [-t tolerance] [-o output] session.log command [arguments ...]\n");
+
+}
+
+int main(int argc, char** argv) {
+
+    int runs = 1;
+    double tolerance = 0;
+    const char* output = NULL;
+    int option;
+
+    // Options end at the session log, everything after it belongs to the tracker command
+    while ((option = getopt(argc, argv, "+r:t:o:h")) != -1) {
+        switch (option) {
+        case 'r': runs = atoi(optarg); break;
+        case 't': tolerance = atof(optarg); break;
+        case 'o': output = optarg; break;
+        default: usage(); return option == 'h' ? 0 : 2;
+        }
+    }
+
+    if (argc - optind < 2 || runs < 1) {
+        usage();
+        return 2;
+    }
+
+    const char* session = argv[optind];
+    char** command = argv + optind + 1;
+
+    Replies recorded;
+
+    if (!load(session, recorded)) {
+        fprintf(stderr, "Unable to read session log %s\n", session);
+        return 2;
+    }
+
+    std::string temporary;
+
+    if (!output) {
+        char name[] = "/tmp/vot_replay_XXXXXX";
+        int descriptor = mkstemp(name);
+        if (descriptor < 0) {
+            perror("mkstemp");
+            return 2;
+        }
+        close(descriptor);
+        temporary = name;
+        output = temporary.c_str();
+    }
+
+    int failed = 0;
+
+    for (int r = 0; r < runs; r++) {
+
+        // A log left by the previous run must not pass for this one, a missing log is a failure
+        unlink(output);
+
+        auto start = std::chrono::steady_clock::now();
+        int status = run(command, session, output);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        Replies replayed;
+
+        if (status != 0 || !load(output, replayed) || !replayed.complete) {
+            fprintf(stderr, "Run %d: tracker failed (exit status %d)\n", r + 1, status);
+            failed = 1;
+            continue;
+        }
+
+        int mismatches = 0;
+
+        for (size_t i = 0; i < recorded.regions.size(); i++) {
+
+            bool equal = i < replayed.regions.size() && recorded.regions[i].size() == replayed.regions[i].size();
+
+            for (size_t j = 0; equal && j < recorded.regions[i].size(); j++) {
+                if (!same(recorded.regions[i][j], replayed.regions[i][j], tolerance)) {
+                    if (!mismatches)
+                        fprintf(stderr, "Run %d: reply %d, object %d differs: expected %s, got %s\n", r + 1, (int) i, (int) j,
+                            recorded.regions[i][j].c_str(), replayed.regions[i][j].c_str());
+                    equal = false;
+                }
+            }
+
+            if (!equal)
+                mismatches++;
+
+        }
+
+        if (replayed.regions.size() != recorded.regions.size()) {
+            fprintf(stderr, "Run %d: %d replies recorded, %d replayed\n", r + 1, (int) recorded.regions.size(), (int) replayed.regions.size());
+            mismatches++;
+        }
+
+        // The first reply only confirms the initialization, the tracker is initialized before the reply to the first frame
+        int frames = (int) replayed.regions.size() - 1;
+        double first = frames > 0 ? replayed.times[1] : 0;
+        double tracking = frames > 1 ? replayed.times.back() - first : 0;
+
+        printf("Run %d: %d frames in %.3f s, first frame after %.3f s, %.1f frames/s, %d mismatches\n", r + 1, frames, elapsed,
+            first, tracking > 0 ? (frames - 1) / tracking : 0.0, mismatches);
+
+        if (mismatches)
+            failed = 1;
+
+    }
+
+    if (!temporary.empty())
+        remove(temporary.c_str());
+
+    return failed;
+
+}
@@ -0,0 +1,221 @@
+/* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * Native implementation of the per-frame hot path of the vot.py wrapper:
+ * parsing of region text (including RLE encoded masks) and encoding of masks.
+ * Masks are read through the buffer protocol and decoded masks are returned
+ * as bytearrays that are wrapped by numpy without a copy. The module is
+ * optional, vot.py falls back to the pure Python implementation if it is not
+ * built (python setup.py build_ext --inplace).
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/**
+ * Parses a comma separated list of numbers. Returns false if the text
+ * contains anything else.
+ */
+static bool parse_numbers(const char* text, std::vector<double>& numbers) {
+
+    const char* position = text;
+
+    while (true) {
+
+        char* end;
+        double value = strtod(position, &end);
+
+        if (end == position)
+            return false;
+
+        numbers.push_back(value);
+
+        while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+            end++;
+
+        if (*end == '\0')
+            return true;
+
+        if (*end != ',')
+            return false;
+
+        position = end + 1;
+
+    }
+
+}
+
+/**
+ * Parses a region line. Masks are returned as a tuple (x, y, width, height,
+ * data) where data is a bytearray with (y + height) * (x + width) elements,
+ * other regions as a tuple of numbers.
+ */
+static PyObject* parse_region(PyObject* self, PyObject* args) {
+
+    const char* line;
+
+    if (!PyArg_ParseTuple(args, "s", &line))
+        return NULL;
+
+    while (*line == ' ' || *line == '\t')
+        line++;
+
+    bool mask = *line == 'm';
+    std::vector<double> numbers;
+
+    if (!parse_numbers(mask ? line + 1 : line, numbers)) {
+        PyErr_Format(PyExc_ValueError, "Unable to parse region: %s", line);
+        return NULL;
+    }
+
+    if (!mask) {
+
+        PyObject* result = PyTuple_New(numbers.size());
+
+        if (!result)
+            return NULL;
+
+        for (size_t i = 0; i < numbers.size(); i++) {
+            PyTuple_SET_ITEM(result, i, PyFloat_FromDouble(numbers[i]));
+        }
+
+        return result;
+
+    }
+
+    if (numbers.size() < 4 || numbers[0] < 0 || numbers[1] < 0 || numbers[2] < 0 || numbers[3] < 0) {
+        PyErr_Format(PyExc_ValueError, "Illegal mask header: %s", line);
+        return NULL;
+    }
+
+    Py_ssize_t ox = (Py_ssize_t) numbers[0], oy = (Py_ssize_t) numbers[1];
+    Py_ssize_t width = (Py_ssize_t) numbers[2], height = (Py_ssize_t) numbers[3];
+    Py_ssize_t stride = ox + width;
+
+    PyObject* data = PyByteArray_FromStringAndSize(NULL, stride * (oy + height));
+
+    if (!data)
+        return NULL;
+
+    char* pixels = PyByteArray_AS_STRING(data);
+    memset(pixels, 0, stride * (oy + height));
+
+    // Runs alternate between zeros and ones and start with zeros, ones are written row by row into the padded mask
+    Py_ssize_t index = 0, total = width * height;
+
+    for (size_t i = 4; i < numbers.size(); i++) {
+
+        Py_ssize_t run = (Py_ssize_t) numbers[i];
+
+        if (run < 0 || run > total - index) {
+            Py_DECREF(data);
+            PyErr_SetString(PyExc_ValueError, "Mask runs exceed the mask size");
+            return NULL;
+        }
+
+        if (i % 2 == 1) {
+            for (Py_ssize_t j = index; j < index + run; ) {
+                Py_ssize_t row = j / width, column = j % width;
+                Py_ssize_t length = width - column < index + run - j ? width - column : index + run - j;
+                memset(pixels + (oy + row) * stride + ox + column, 1, length);
+                j += length;
+            }
+        }
+
+        index += run;
+
+    }
+
+    return Py_BuildValue("(nnnnN)", ox, oy, width, height, data);
+
+}
+
+/**
+ * Encodes a two dimensional mask with one byte elements (uint8 or bool) to
+ * the RLE text format. Only the bounding box of non-zero elements is encoded.
+ */
+static PyObject* encode_mask(PyObject* self, PyObject* args) {
+
+    PyObject* object;
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "O", &object))
+        return NULL;
+
+    if (PyObject_GetBuffer(object, &view, PyBUF_STRIDES) < 0)
+        return NULL;
+
+    if (view.ndim != 2 || view.itemsize != 1) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "Mask has to be a two dimensional array with one byte elements");
+        return NULL;
+    }
+
+    const char* buffer = (const char*) view.buf;
+    Py_ssize_t rows = view.shape[0], columns = view.shape[1];
+    Py_ssize_t row_stride = view.strides[0], column_stride = view.strides[1];
+
+    Py_ssize_t left = columns, top = rows, right = -1, bottom = -1;
+
+    for (Py_ssize_t y = 0; y < rows; y++) {
+        const char* row = buffer + y * row_stride;
+        for (Py_ssize_t x = 0; x < columns; x++) {
+            if (row[x * column_stride]) {
+                if (x < left) left = x;
+                if (x > right) right = x;
+                if (y < top) top = y;
+                bottom = y;
+            }
+        }
+    }
+
+    if (right < 0) {
+        PyBuffer_Release(&view);
+        return PyUnicode_FromString("0");
+    }
+
+    std::string text = "m" + std::to_string(left) + "," + std::to_string(top) + "," +
+        std::to_string(right - left + 1) + "," + std::to_string(bottom - top + 1);
+
+    // The first run counts zeros, it is empty if the mask starts with a one
+    bool value = false;
+    Py_ssize_t count = 0;
+
+    for (Py_ssize_t y = top; y <= bottom; y++) {
+        const char* row = buffer + y * row_stride;
+        for (Py_ssize_t x = left; x <= right; x++) {
+            bool current = row[x * column_stride] != 0;
+            if (current != value) {
+                text += "," + std::to_string(count);
+                value = current;
+                count = 0;
+            }
+            count++;
+        }
+    }
+
+    text += "," + std::to_string(count);
+
+    PyBuffer_Release(&view);
+
+    return PyUnicode_FromStringAndSize(text.c_str(), text.size());
+
+}
+
+static PyMethodDef methods[] = {
+    {"parse_region", parse_region, METH_VARARGS, "Parse a region line, masks are returned as (x, y, width, height, bytearray)."},
+    {"encode_mask", encode_mask, METH_VARARGS, "Encode a two dimensional one byte mask to the RLE text format."},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "_vot", "Native hot path of the vot wrapper.", -1, methods
+};
+
+PyMODINIT_FUNC PyInit__vot(void) {
+    return PyModule_Create(&module);
+}
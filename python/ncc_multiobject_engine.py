@@ -0,0 +1,11 @@
+#!/usr/bin/python
+
+# This is a simple example of a multi object tracker implemented in Python. It uses the same VOT manager integration as ncc_multiobject_manager.py,
+# but all objects are tracked together by NCCMultiTracker: each frame is read and converted once and objects with overlapping search windows share integral images.
+
+import vot
+from ncc_tracker import NCCMultiTracker
+
+if __name__ == "__main__":
+    manager = vot.VOTManager(NCCMultiTracker().factory(), "rectangle")
+    manager.run()
@@ -8,7 +8,9 @@ import cv2
 
 def NCCTracker(image, region):
         
-    image = cv2.imread(image, cv2.IMREAD_GRAYSCALE)
+    # The manager decodes frames once for all objects, paths are only given if decoding is disabled
+    if isinstance(image, str):
+        image = cv2.imread(image, cv2.IMREAD_GRAYSCALE)
     window = max(region.width, region.height) * 2
 
     left = max(region.x, 0)
@@ -22,7 +24,8 @@ def NCCTracker(image, region):
     size = (region.width, region.height)
 
     def track(image):
-        image = cv2.imread(image, cv2.IMREAD_GRAYSCALE)
+        if isinstance(image, str):
+            image = cv2.imread(image, cv2.IMREAD_GRAYSCALE)
 
         left = max(round(position[0] - float(window) / 2), 0)
         top = max(round(position[1] - float(window) / 2), 0)
@@ -51,5 +54,5 @@ def NCCTracker(image, region):
 
 if __name__ == "__main__":
     print(vot.__file__)
-    manager = vot.VOTManager(NCCTracker, "rectangle")
+    manager = vot.VOTManager(NCCTracker, "rectangle", decode="gray")
     manager.run()
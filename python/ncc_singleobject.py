@@ -11,7 +11,10 @@ from ncc_tracker import NCCTrackerImpl
 
 class NCCTracker(object):
     def __init__(self, image, region):
-        self.ncc_ = NCCTrackerImpl(image, region)
+        # Run with --scale to enable scale search and with --update to enable template update
+        scale_step = 1.05 if "--scale" in sys.argv else 1.0
+        update_rate = 0.05 if "--update" in sys.argv else 0.0
+        self.ncc_ = NCCTrackerImpl(image, region, scale_step=scale_step, scale_levels=14, update_rate=update_rate)
 
     def track(self, image):
         pred_region, max_val = self.ncc_.track(image)
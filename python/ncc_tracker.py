@@ -1,11 +1,33 @@
+import os
+import threading
+import concurrent.futures
 import cv2
 import numpy as np
 import vot
 
 
+# Responses of other scales are penalized slightly to keep the size stable
+SCALE_PENALTY = 0.98
+
+_executor = None
+
+def _matcher():
+    """ Shared thread pool for matching scales in parallel, OpenCV releases the GIL while matching """
+    global _executor
+    if _executor is None:
+        _executor = concurrent.futures.ThreadPoolExecutor(max_workers=min(3, os.cpu_count() or 1))
+    return _executor
+
+
 class NCCTrackerImpl(object):
 
-    def __init__(self, image, region):
+    def __init__(self, image, region, scale_step=1.0, scale_levels=7, update_rate=0.0, update_threshold=0.7):
+        """ Scale search is enabled with scale_step larger than one. Templates for scales scale_step ** k,
+            k = -scale_levels..scale_levels, are resampled once, each frame the current scale and its two neighbours
+            are matched against the same search window.
+
+            With a positive update_rate the matched template is blended with the matched patch (an exponentially
+            weighted average) in frames where the confidence reaches update_threshold, so occluders are not learned. """
         if isinstance(region, np.ndarray):
             region = self._rect_from_mask(region)
             region = vot.Rectangle(region[0], region[1], region[2], region[3])
@@ -22,6 +44,25 @@ class NCCTrackerImpl(object):
         self.position = (region.x + region.width / 2, region.y + region.height / 2)
         self.size = (region.width, region.height)
 
+        self.scale_step = scale_step
+        self.scale_levels = scale_levels if scale_step > 1 else 0
+        self.base_size = self.size
+        self.level = self.scale_levels
+        self.templates = []
+        self.update_rate = update_rate
+        self.update_threshold = update_threshold
+
+        for i in range(2 * self.scale_levels + 1):
+            scale = self.scale_step ** (i - self.scale_levels)
+            if i == self.scale_levels:
+                self.templates.append(self.template)
+                continue
+            size = (max(1, int(round(self.template.shape[1] * scale))), max(1, int(round(self.template.shape[0] * scale))))
+            self.templates.append(cv2.resize(self.template, size, interpolation=cv2.INTER_AREA if scale < 1 else cv2.INTER_LINEAR))
+
+        # Running averages of updated templates, kept in floating point to avoid rounding drift
+        self.accumulators = [None] * len(self.templates)
+
     def track(self, image):
         left = max(round(self.position[0] - float(self.window) / 2), 0)
         top = max(round(self.position[1] - float(self.window) / 2), 0)
@@ -29,18 +70,60 @@ class NCCTrackerImpl(object):
         right = min(round(self.position[0] + float(self.window) / 2), image.shape[1] - 1)
         bottom = min(round(self.position[1] + float(self.window) / 2), image.shape[0] - 1)
 
-        if right - left < self.template.shape[1] or bottom - top < self.template.shape[0]:
-            return [self.position[0] + self.size[0] / 2, self.position[1] + self.size[1] / 2, self.size[0], self.size[1]], 0
+        # Candidate scales are the current one and its neighbours in the template bank
+        levels = [i for i in range(max(self.level - 1, 0), min(self.level + 1, len(self.templates) - 1) + 1)
+                  if right - left >= self.templates[i].shape[1] and bottom - top >= self.templates[i].shape[0]]
+
+        if not levels:
+            return [self.position[0] - self.size[0] / 2, self.position[1] - self.size[1] / 2, self.size[0], self.size[1]], 0
 
         cut = image[int(top):int(bottom), int(left):int(right)]
 
-        matches = cv2.matchTemplate(cut, self.template, cv2.TM_CCOEFF_NORMED)
-        min_val, max_val, min_loc, max_loc = cv2.minMaxLoc(matches)
+        def match(level):
+            matches = cv2.matchTemplate(cut, self.templates[level], cv2.TM_CCOEFF_NORMED)
+            _, max_val, _, max_loc = cv2.minMaxLoc(matches)
+            return level, max_val, max_loc
+
+        if len(levels) > 1:
+            responses = list(_matcher().map(match, levels))
+        else:
+            responses = [match(levels[0])]
+
+        level, max_val, max_loc = max(responses, key=lambda r: r[1] if r[0] == self.level else r[1] * SCALE_PENALTY)
+
+        if level != self.level:
+            self._resample(self.level, level)
+            self.level = level
+            scale = self.scale_step ** (level - self.scale_levels)
+            self.size = (self.base_size[0] * scale, self.base_size[1] * scale)
+            self.window = max(self.size) * 2
+
+        if self.update_rate > 0 and max_val >= self.update_threshold:
+            self._update(cut, max_loc, level)
 
         self.position = (left + max_loc[0] + float(self.size[0]) / 2, top + max_loc[1] + float(self.size[1]) / 2)
 
         return [left + max_loc[0], top + max_loc[1], self.size[0], self.size[1]], max_val
 
+    def _update(self, cut, location, level):
+        """ Blend the template with the matched patch """
+        height, width = self.templates[level].shape[:2]
+        if self.accumulators[level] is None:
+            self.accumulators[level] = self.templates[level].astype(np.float32)
+        cv2.accumulateWeighted(cut[location[1]:location[1] + height, location[0]:location[0] + width], self.accumulators[level], self.update_rate)
+        template = self.templates[level]
+        self.templates[level] = cv2.convertScaleAbs(self.accumulators[level]) if template.dtype == np.uint8 else self.accumulators[level].astype(template.dtype)
+
+    def _resample(self, source, target):
+        """ Carry the learned appearance to a new scale, otherwise its template would still be the initial one """
+        if self.accumulators[source] is None:
+            return
+        height, width = self.templates[target].shape[:2]
+        self.accumulators[target] = cv2.resize(self.accumulators[source], (width, height),
+            interpolation=cv2.INTER_AREA if target < source else cv2.INTER_LINEAR)
+        template = self.templates[target]
+        self.templates[target] = cv2.convertScaleAbs(self.accumulators[target]) if template.dtype == np.uint8 else self.accumulators[target].astype(template.dtype)
+
     def _rect_from_mask(self, mask):
         '''
         create an axis-aligned rectangle from a given binary mask
@@ -66,4 +149,166 @@ class NCCTrackerImpl(object):
         x1 = min(int(round(rect[0] + rect[2])), output_size[0])
         y1 = min(int(round(rect[1] + rect[3])), output_size[1])
         mask[y0:y1, x0:x1] = 1
-        return mask
\ No newline at end of file
+        return mask
+
+class NCCMultiTracker(object):
+    """ NCC tracker for many objects at once. All objects share one grayscale frame, search windows that overlap are
+        merged into groups and the integral images of a group region are computed once for all of its objects. Each
+        window is then correlated with its raw template and normalized with the shared sums, which gives the same
+        responses as cv2.TM_CCOEFF_NORMED used by NCCTrackerImpl. """
+
+    def __init__(self):
+        self._objects = []
+        self._frames = 0
+        self._results = []
+        self._lock = threading.Lock()
+
+    def add(self, image, region):
+        """ Add an object, returns its index in the results of track """
+        if isinstance(region, np.ndarray):
+            region = vot.Rectangle(*NCCTrackerImpl._rect_from_mask(None, region))
+
+        image = self._gray(image)
+
+        left = max(region.x, 0)
+        top = max(region.y, 0)
+
+        right = min(region.x + region.width, image.shape[1] - 1)
+        bottom = min(region.y + region.height, image.shape[0] - 1)
+
+        template = image[int(top):int(bottom), int(left):int(right)]
+        centered = template.astype(np.float64) - template.mean()
+
+        self._objects.append(dict(template=template, mean=float(template.mean()), energy=float(np.sum(centered * centered)),
+            position=[region.x + region.width / 2, region.y + region.height / 2], size=(region.width, region.height),
+            window=max(region.width, region.height) * 2))
+
+        return len(self._objects) - 1
+
+    def remove(self, index):
+        """ Remove an object, it is no longer tracked and its result is None, indices of other objects do not change """
+        self._objects[index] = None
+
+    def track(self, image):
+        """ Track all objects in a new frame, returns a list of (rectangle, confidence) tuples, None for removed objects """
+        image = self._gray(image)
+
+        windows = [self._window(o, image.shape) if o is not None else None for o in self._objects]
+        results = []
+
+        for o in self._objects:
+            if o is None:
+                results.append(None)
+                continue
+            results.append(([o["position"][0] - o["size"][0] / 2, o["position"][1] - o["size"][1] / 2, o["size"][0], o["size"][1]], 0))
+
+        for (left, top, right, bottom), members in self._merge(windows):
+
+            region = image[top:bottom, left:right]
+            sums, squares = cv2.integral2(region, sdepth=cv2.CV_64F, sqdepth=cv2.CV_64F)
+
+            for i in members:
+                o = self._objects[i]
+                th, tw = o["template"].shape
+                wl, wt, wr, wb = windows[i]
+
+                # Window coordinates relative to the region
+                wl, wt, wr, wb = wl - left, wt - top, wr - left, wb - top
+
+                def box(integral):
+                    return integral[wt + th:wb + 1, wl + tw:wr + 1] - integral[wt:wb - th + 1, wl + tw:wr + 1] - \
+                        integral[wt + th:wb + 1, wl:wr - tw + 1] + integral[wt:wb - th + 1, wl:wr - tw + 1]
+
+                # Correlation with the zero-mean template is the raw correlation minus the template mean times the sum
+                total = box(sums)
+                numerator = cv2.matchTemplate(region[wt:wb, wl:wr], o["template"], cv2.TM_CCORR) - total * o["mean"]
+                variance = np.maximum(box(squares) - total * total / (th * tw), 0)
+                denominator = np.sqrt(variance * o["energy"])
+                response = np.divide(numerator, denominator, out=np.zeros_like(numerator), where=denominator > 1e-6)
+
+                y, x = np.unravel_index(np.argmax(response), response.shape)
+
+                x, y = int(x) + wl + left, int(y) + wt + top
+
+                o["position"] = [x + float(o["size"][0]) / 2, y + float(o["size"][1]) / 2]
+                results[i] = ([x, y, o["size"][0], o["size"][1]], float(response[y - wt - top, x - wl - left]))
+
+        self._frames += 1
+        self._results = results
+
+        return results
+
+    def factory(self):
+        """ Returns a tracker factory for VOTManager, objects created by it are tracked together. The first object that
+            receives a new frame tracks all of them, the others wait for it when the manager runs them concurrently.
+            Trackers of retired objects are closed by the manager, which removes their objects. """
+        def create(image, region):
+            with self._lock:
+                index = self.add(image, region)
+            calls = [self._frames]
+
+            def track(image):
+                calls[0] += 1
+                with self._lock:
+                    if calls[0] > self._frames:
+                        self.track(image)
+                    return vot.Rectangle(*self._results[index][0])
+
+            def close():
+                with self._lock:
+                    self.remove(index)
+
+            track.close = close
+
+            return track
+
+        return create
+
+    def _gray(self, image):
+        if isinstance(image, str):
+            return cv2.imread(image, cv2.IMREAD_GRAYSCALE)
+        if image.ndim == 3:
+            return cv2.cvtColor(image, cv2.COLOR_BGR2GRAY)
+        return image
+
+    @staticmethod
+    def _window(o, shape):
+        """ Search window of an object (same as in NCCTrackerImpl) or None if the template does not fit into it """
+        left = int(max(round(o["position"][0] - float(o["window"]) / 2), 0))
+        top = int(max(round(o["position"][1] - float(o["window"]) / 2), 0))
+
+        right = int(min(round(o["position"][0] + float(o["window"]) / 2), shape[1] - 1))
+        bottom = int(min(round(o["position"][1] + float(o["window"]) / 2), shape[0] - 1))
+
+        if right - left < o["template"].shape[1] or bottom - top < o["template"].shape[0]:
+            return None
+
+        return (left, top, right, bottom)
+
+    @staticmethod
+    def _merge(windows):
+        """ Groups overlapping windows, two groups are merged only if their union is not larger than both together """
+        groups = [(window, [i]) for i, window in enumerate(windows) if window is not None]
+
+        def area(r):
+            return (r[2] - r[0]) * (r[3] - r[1])
+
+        merged = True
+        while merged:
+            merged = False
+            for a in range(len(groups)):
+                for b in range(a + 1, len(groups)):
+                    ra, rb = groups[a][0], groups[b][0]
+                    if ra[0] >= rb[2] or rb[0] >= ra[2] or ra[1] >= rb[3] or rb[1] >= ra[3]:
+                        continue
+                    union = (min(ra[0], rb[0]), min(ra[1], rb[1]), max(ra[2], rb[2]), max(ra[3], rb[3]))
+                    if area(union) > area(ra) + area(rb):
+                        continue
+                    groups[a] = (union, groups[a][1] + groups[b][1])
+                    del groups[b]
+                    merged = True
+                    break
+                if merged:
+                    break
+
+        return groups
@@ -0,0 +1,15 @@
+"""
+Builds the optional native module of the vot wrapper in place:
+
+    python setup.py build_ext --inplace
+
+vot.py uses the pure Python implementation if the module is not available.
+"""
+
+from setuptools import setup, Extension
+
+setup(
+    name="vot-wrapper",
+    py_modules=["vot"],
+    ext_modules=[Extension("_vot", ["_vot.cpp"], language="c++", optional=True)],
+)
@@ -10,6 +10,10 @@
 """
 
 import os
+import sys
+import time
+import struct
+import hashlib
 import collections
 import numpy as np
 
@@ -23,6 +27,18 @@ try:
 except ImportError:
     _USE_TRAX = False
 
+# Session logs in the format of vot.h, a recorded session is replayed instead of connecting to a client (see vot_replay)
+_REPLAY = os.environ.get("VOT_REPLAY", "")
+_RECORD = os.environ.get("VOT_RECORD", "")
+
+# Native hot path (region parsing and mask encoding), built with setup.py, the Python implementation is used without it
+try:
+    if os.environ.get("VOT_USE_NATIVE", "1") != "1":
+        raise ImportError()
+    import _vot as _native
+except ImportError:
+    _native = None
+
 Rectangle = collections.namedtuple('Rectangle', ['x', 'y', 'width', 'height'])
 Point = collections.namedtuple('Point', ['x', 'y'])
 Polygon = collections.namedtuple('Polygon', ['points'])
@@ -31,22 +47,22 @@ Empty = collections.namedtuple('Empty', [])
 def _parse_region(line):
     """ Parse a region from a line of text, the format can be either rectangle, polygon or mask. """
     line = line.strip()
-    if line[0] == 'm':
+    if _native is not None:
+        tokens = _native.parse_region(line)
+        if line[0] == 'm':
+            ox, oy, width, height, data = tokens
+            # The bytearray is wrapped without a copy
+            return np.frombuffer(data, dtype=np.uint8).reshape((oy + height, ox + width))
+    elif line[0] == 'm':
         # input is a mask - decode it
-        encoded = [int(x) for x in line[1:].split(",")]
-        ox, oy, width, height = encoded[:4]
-
-        v = np.zeros(width * height, dtype=np.uint8)
-
-        # set id of the last different element to the beginning of the vector
-        idx_ = 0
-        for i in range(len(encoded[4:])):
-            if i % 2 != 0:
-                # write as many 1s as RLE says (zeros are already in the vector)
-                for j in range(encoded[4+i]):
-                    v[idx_+j] = 1
-            idx_ += encoded[4+i]
-        
+        encoded = np.array([int(x) for x in line[1:].split(",")], dtype=np.int64)
+        ox, oy, width, height = (int(x) for x in encoded[:4])
+
+        # runs alternate between zeros and ones, starting with zeros
+        runs = encoded[4:]
+        v = np.repeat(np.arange(len(runs)) % 2, runs).astype(np.uint8)
+        v = np.pad(v, (0, width * height - len(v)))
+
         v = v.reshape((height, width))
         # Pad the mask to the original size of the image, the offset is given by (ox, oy)
         m_ = np.zeros((oy + height, ox + width), dtype=np.uint8)
@@ -54,16 +70,17 @@ def _parse_region(line):
         
         return m_
     else:
-        # input is not a mask - check if special, rectangle or polygon
         tokens = [float(t) for t in line.split(",")]
-        if len(tokens) == 1:
-            return Empty()
-        if len(tokens) == 2:
-            return Point(tokens[0], tokens[1])
-        if len(tokens) == 4:
-            return Rectangle(tokens[0], tokens[1], tokens[2], tokens[3])
-        elif len(tokens) % 2 == 0 and len(tokens) > 4:
-            return Polygon([(x_, y_) for x_, y_ in zip(tokens[::2], tokens[1::2])])
+
+    # input is not a mask - check if special, rectangle or polygon
+    if len(tokens) == 1:
+        return Empty()
+    if len(tokens) == 2:
+        return Point(tokens[0], tokens[1])
+    if len(tokens) == 4:
+        return Rectangle(tokens[0], tokens[1], tokens[2], tokens[3])
+    elif len(tokens) % 2 == 0 and len(tokens) > 4:
+        return Polygon([Point(x_, y_) for x_, y_ in zip(tokens[::2], tokens[1::2])])
     return None
 
 def _encode_region(region):
@@ -77,23 +94,64 @@ def _encode_region(region):
     elif isinstance(region, Polygon):
         return ",".join(f"{point.x},{point.y}" for point in region.points)
     elif isinstance(region, np.ndarray):
+        if _native is not None and region.ndim == 2 and region.itemsize == 1:
+            return _native.encode_mask(region)
         ys, xs = np.nonzero(region)
         if len(xs) == 0 or len(ys) == 0: return "0"
         ox, oy = xs.min(), ys.min()
         width, height = xs.max() - ox + 1, ys.max() - oy + 1
-        v = region[oy:oy+height, ox:ox+width].flatten()
-        rle = []
-        count = 1
-        for i in range(1, len(v)):
-            if v[i] != v[i-1]:
-                rle.append(count)
-                count = 1
-            else:
-                count += 1
-        rle.append(count)
+        v = (region[oy:oy+height, ox:ox+width] != 0).flatten()
+        # runs alternate between zeros and ones, the first run counts zeros and is empty if the mask starts with a one
+        changes = np.flatnonzero(v[1:] != v[:-1]) + 1
+        rle = np.diff(np.concatenate(([0], changes, [len(v)])))
+        if v[0]:
+            rle = np.concatenate(([0], rle))
 
         return f"m{ox},{oy},{width},{height}," + ",".join(str(x) for x in rle)
 
+def _convert_trax(region):
+    """ Convert region to TraX format """
+    # If region is None, return empty region
+    if region is None: return trax.Rectangle.create(0, 0, 0, 0)
+    if isinstance(region, np.ndarray):
+        return trax.Mask.create(region)
+    elif isinstance(region, Rectangle):
+        return trax.Rectangle.create(region.x, region.y, region.width, region.height)
+    elif isinstance(region, Polygon):
+        return trax.Polygon.create([(x.x, x.y) for x in region.points])
+    assert isinstance(region, Empty)
+    return trax.Rectangle.create(0, 0, 0, 0)
+
+def _convert_object(tobject):
+    """ Converts a TraX region to a region of the wrapper """
+    if isinstance(tobject, trax.Polygon):
+        return Polygon([Point(x[0], x[1]) for x in tobject])
+    elif isinstance(tobject, trax.Mask):
+        return tobject.array(True)
+    else:
+        return Rectangle(*tobject.bounds())
+
+def _convert_format(region, region_format):
+    """ Converts a region to the given format as the client would do, masks are reduced to their bounds """
+    if isinstance(region, np.ndarray):
+        if region_format == "mask":
+            return region
+        ys, xs = np.nonzero(region)
+        if len(xs) == 0:
+            return Empty()
+        region = Rectangle(float(xs.min()), float(ys.min()), float(xs.max() - xs.min() + 1), float(ys.max() - ys.min() + 1))
+    if isinstance(region, Polygon) and region_format != "polygon":
+        xs, ys = [p.x for p in region.points], [p.y for p in region.points]
+        region = Rectangle(min(xs), min(ys), max(xs) - min(xs), max(ys) - min(ys))
+    if isinstance(region, Rectangle) and region_format == "polygon":
+        return Polygon([Point(region.x, region.y), Point(region.x + region.width, region.y),
+            Point(region.x + region.width, region.y + region.height), Point(region.x, region.y + region.height)])
+    if isinstance(region, Rectangle) and region_format == "mask":
+        mask = np.zeros((int(round(region.y + region.height)), int(round(region.x + region.width))), dtype=np.uint8)
+        mask[int(round(region.y)):, int(round(region.x)):] = 1
+        return mask
+    return region
+
 def _validate_region(region, valid_formats):
     if isinstance(region, Empty):
         return "empty" in valid_formats
@@ -108,10 +166,95 @@ def _validate_region(region, valid_formats):
     else:
         return False
 
+class _SessionLog(object):
+    """ Session log of vot.h (see vot_log_write): a header with channels and flags followed by records of requests and
+        replies, each with its type, time, images, objects and properties. Numbers are little endian 32 bit integers,
+        strings are prefixed with their length. Only images given as paths are supported. """
+
+    INITIALIZE, FRAME, QUIT, STATE = 2, 3, 4, 5
+    CHANNELS = {"color": 1, "depth": 2, "ir": 4}
+    PATH = 1
+
+    def __init__(self, filename, write=False, channels=0, flags=0):
+        self._file = open(filename, "wb" if write else "rb")
+        self._start = time.perf_counter()
+        if write:
+            self.channels, self.flags = channels, flags
+            self._file.write(b"VOTL" + struct.pack("<III", 1, channels, flags))
+        else:
+            header = self._file.read(16)
+            if len(header) != 16 or header[:4] != b"VOTL" or struct.unpack("<I", header[4:8])[0] != 1:
+                raise RuntimeError(f"File {filename} is not a session log")
+            self.channels, self.flags = struct.unpack("<II", header[8:])
+
+    def _string(self, text):
+        data = text.encode("utf-8")
+        return struct.pack("<I", len(data)) + data
+
+    def _properties(self, properties):
+        properties = properties or {}
+        return struct.pack("<I", len(properties)) + b"".join(self._string(str(k)) + self._string(str(v)) for k, v in properties.items())
+
+    def write(self, type, images=None, objects=None, properties=None):
+        """ Appends a record, images are a dictionary of channel names and paths, objects a list of regions """
+        microseconds = int((time.perf_counter() - self._start) * 1e6)
+        images = images or {}
+        objects = objects or []
+        record = [struct.pack("<BIII", type, microseconds & 0xFFFFFFFF, microseconds >> 32, len(images))]
+        for channel, path in images.items():
+            record.append(struct.pack("<II", self.CHANNELS[channel], self.PATH) + self._string(path))
+        record.append(struct.pack("<I", len(objects)))
+        for region in objects:
+            record.append(self._string(_encode_region(region)) + self._properties(None))
+        record.append(self._properties(properties))
+        self._file.write(b"".join(record))
+        self._file.flush()
+
+    def _read(self, size):
+        data = self._file.read(size)
+        if len(data) != size:
+            raise RuntimeError("Session log is truncated")
+        return data
+
+    def _read_int(self):
+        return struct.unpack("<I", self._read(4))[0]
+
+    def _read_string(self):
+        return self._read(self._read_int()).decode("utf-8")
+
+    def _read_properties(self):
+        return {self._read_string(): self._read_string() for _ in range(self._read_int())}
+
+    def read(self):
+        """ Reads the next record as a tuple (type, images, objects, properties), images are a dictionary of channel
+            names and paths and objects a list of regions. Returns None at the end of the log. """
+        type = self._file.read(1)
+        if not type:
+            return None
+        _, _, count = struct.unpack("<III", self._read(12))
+        names = {v: k for k, v in self.CHANNELS.items()}
+        images = {}
+        for _ in range(count):
+            channel, kind = struct.unpack("<II", self._read(8))
+            if kind != self.PATH:
+                raise RuntimeError("Session log contains images that the tracker does not accept")
+            images[names[channel]] = self._read_string()
+        objects = []
+        for _ in range(self._read_int()):
+            objects.append(_parse_region(self._read_string()))
+            self._read_properties()
+        return type[0], images, objects, self._read_properties()
+
+    def close(self):
+        if self._file is not None:
+            self._file.close()
+            self._file = None
+
 class VOT(object):
     """ Base class for VOT toolkit integration in Python.
         This class is only a wrapper around the TraX protocol and can be used for single or multi-object tracking.
-        The wrapper assumes that the experiment will provide new objects onlf at the first frame and will fail otherwise."""
+        By default the wrapper assumes that the experiment will provide new objects only at the first frame and will fail
+        otherwise, trackers that can start and stop objects during the sequence enable that with accept_objects."""
     def __init__(self, region_format, channels=None, multiobject: bool = None):
         """ Constructor for the VOT wrapper.
 
@@ -141,8 +284,37 @@ class VOT(object):
 
         self._trax = None
         self._multiobject = multiobject    
-        
-        if _USE_TRAX:
+        self._channels = channels
+        self._accept_objects = False
+        self._added = []
+        self._retired = []
+        self._replay = None
+        self._record = None
+        self._region_format = region_format
+
+        if _RECORD:
+            self._record = _SessionLog(_RECORD, True, sum(_SessionLog.CHANNELS[c] for c in channels), int(multiobject))
+
+        if _REPLAY:
+
+            # Requests are read from a recorded session instead of a client
+            self._replay = _SessionLog(_REPLAY)
+
+            if any(not (self._replay.channels & _SessionLog.CHANNELS[c]) for c in channels):
+                raise RuntimeError(f"Session log {_REPLAY} does not contain all channels of the tracker")
+
+            request = self._replay_wait()
+            assert request is not None and request[0] == _SessionLog.INITIALIZE
+
+            self._objects = request[1]
+
+            assert len(self._objects) > 0 and (multiobject or len(self._objects) == 1)
+
+            self._image = request[2]
+
+            self.report(self._objects if multiobject else self._objects[0])
+
+        elif _USE_TRAX:
     
             self._trax = trax.Server([region_format], ["path"], channels, metadata=dict(vot="python"), multiobject=multiobject)
 
@@ -153,18 +325,16 @@ class VOT(object):
 
             assert len(request.objects) > 0 and (multiobject or len(request.objects) == 1)
 
-            for tobject, _ in request.objects:
-                if isinstance(tobject, trax.Polygon):
-                    self._objects.append(Polygon([Point(x[0], x[1]) for x in tobject]))
-                elif isinstance(tobject, trax.Mask):
-                    self._objects.append(tobject.array(True))
-                else:
-                    self._objects.append(Rectangle(*tobject.bounds()))
+            self._objects = [_convert_object(tobject) for tobject, _ in request.objects]
 
             self._image = [x.path() for k, x in request.image.items()]
             if len(self._image) == 1:
                 self._image = self._image[0]
 
+            if self._record is not None:
+                self._record.write(_SessionLog.INITIALIZE, {k: x.path() for k, x in request.image.items()}, self._objects, request.properties)
+                self._record.write(_SessionLog.STATE, objects=self._objects)
+
             self._trax.status(request.objects)
             
         else:
@@ -174,6 +344,7 @@ class VOT(object):
             self._objects = []
             self._object_keys = []
             self._object_trajectory = []
+            self._pending = []
             
             frames = []
             for _, channel in enumerate(channels):
@@ -202,8 +373,6 @@ class VOT(object):
                     object_id = query_file[len("query_"):-len(".txt")]
                     lines = [line.strip() for line in f if line.strip()]
                     offset = int(lines[0])
-                    if offset != 0:
-                        raise RuntimeError(f"Only offset 0 is supported in the wrapper, but got offset {offset} in file {query_file}")
                     state = _parse_region(lines[1])
                     if not _validate_region(state, [region_format]):
                         raise RuntimeError(f"Invalid region format in file {query_file}")
@@ -212,6 +381,10 @@ class VOT(object):
                         if "=" in line:
                             key, value = line.split("=", 1)
                             properties[key] = value
+                    if offset != 0:
+                        # Objects that start later are added when their frame is reached
+                        self._pending.append((offset, object_id, state))
+                        continue
                     self._objects.append(state)
                     self._object_keys.append(object_id)
                     self._object_trajectory.append([state])
@@ -240,6 +413,40 @@ class VOT(object):
 
         return self._objects
 
+    def accept_objects(self, accept=True):
+        """
+        Accept objects that start after the first frame and retirement of objects. New objects are listed by added and
+        have to be appended to the status after the existing ones, retired objects keep their index and are reported
+        as Empty from then on.
+
+        Arguments:
+            accept: whether objects can be added and retired during the sequence
+        """
+
+        self._accept_objects = accept
+
+    def added(self):
+        """
+        Returns initialization regions of objects that start on the current frame, they are appended to the objects in
+        this order.
+
+        Returns:
+            initialization regions of new objects
+        """
+
+        return self._added
+
+    def retired(self):
+        """
+        Returns indices of objects that were retired on the current frame. TraX has no message for retiring an object,
+        the client lists the indices in the comma separated "retired" property of the frame request.
+
+        Returns:
+            indices of retired objects
+        """
+
+        return self._retired
+
     def report(self, status):
         """
         Report the tracking results to the client
@@ -248,19 +455,11 @@ class VOT(object):
             status: region for the frame or a list of regions in case of multi object tracking
         """
 
-        def convert_trax(region):
-            """ Convert region to TraX format """
-            # If region is None, return empty region
-            if region is None: return trax.Rectangle.create(0, 0, 0, 0)
-            assert isinstance(region, (Empty, Rectangle, Polygon, np.ndarray))
-            if isinstance(region, Empty):
-                return trax.Rectangle.create(0, 0, 0, 0)
-            elif isinstance(region, Polygon):
-                return trax.Polygon.create([(x.x, x.y) for x in region.points])
-            elif isinstance(region, np.ndarray):
-                return trax.Mask.create(region)
-            else:
-                return trax.Rectangle.create(region.x, region.y, region.width, region.height)
+        if self._record is not None:
+            self._record.write(_SessionLog.STATE, objects=status if self._multiobject else [status])
+
+        if self._replay is not None:
+            return
 
         if not _USE_TRAX:
             
@@ -274,10 +473,10 @@ class VOT(object):
         else:
 
             if not self._multiobject:
-                status = [(convert_trax(status))]
+                status = [_convert_trax(status)]
             else:
                 assert isinstance(status, (list, tuple))
-                status = [(convert_trax(x), {}) for x in status]
+                status = [(_convert_trax(x), {}) for x in status]
 
             self._trax.status(status, {})
 
@@ -289,33 +488,112 @@ class VOT(object):
             absolute path of the image
         """
         
+        self._added = []
+        self._retired = []
+
+        if hasattr(self, "_image"):
+            image = self._image
+            del self._image
+            return image
+
+        if self._replay is not None:
+            request = self._replay_wait()
+            if request is None or request[0] != _SessionLog.FRAME:
+                return None
+            _, objects, image, properties = request
+            self._read_objects(objects, properties)
+            return image
+
         if not _USE_TRAX:
             if self._position >= len(self._frames):
                 return None
+            for offset, key, state in self._pending:
+                if offset != self._position:
+                    continue
+                if not self._accept_objects:
+                    raise RuntimeError(f"Object {key} starts at frame {offset}, but the tracker only accepts objects on the first frame")
+                # The trajectory starts with the region reported for the first frame of the object
+                self._added.append(state)
+                self._object_keys.append(key)
+                self._object_trajectory.append([])
             frame = self._frames[self._position]
             self._position += 1
+            if self._record is not None:
+                images = dict(zip(self._channels, [frame] if isinstance(frame, str) else frame))
+                if self._position == 1:
+                    self._record.write(_SessionLog.INITIALIZE, images, self._objects)
+                    self._record.write(_SessionLog.STATE, objects=self._objects)
+                else:
+                    self._record.write(_SessionLog.FRAME, images, self._added)
             return frame
-        
-        if hasattr(self, "_image"):
-            image = self._image
-            del self._image
-            return image
 
         request = self._trax.wait()
 
-        # Only the first frame can declare new objects for now
-        assert request.objects is None or len(request.objects) == 0
+        if request.type != 'frame':
+            return None
+
+        objects = [_convert_object(tobject) for tobject, _ in (request.objects or [])]
+        self._read_objects(objects, request.properties)
 
-        if request.type == 'frame':
-            image = [x.path() for k, x in request.image.items()]
-            if len(image) == 1:
-                return image[0]
-            return image
+        if self._record is not None:
+            self._record.write(_SessionLog.FRAME, {k: x.path() for k, x in request.image.items()}, objects, request.properties)
+
+        image = [x.path() for k, x in request.image.items()]
+        if len(image) == 1:
+            return image[0]
+        return image
+
+    def _read_objects(self, objects, properties):
+        """ Objects and retired indices that are sent with a frame """
+        if self._accept_objects:
+            self._added = objects
+            retired = (properties or {}).get("retired", "")
+            self._retired = [int(index) for index in str(retired).split(",") if index.strip()]
         else:
-            return None
+            # Only the first frame can declare new objects
+            assert len(objects) == 0
+
+    def _replay_wait(self):
+        """ Next request of the replayed session as (type, objects, image, properties), None at the end. Replies that
+            are stored in the log are skipped. """
+        while True:
+            record = self._replay.read()
+            if record is None or record[0] == _SessionLog.QUIT:
+                return None
+            type, images, objects, properties = record
+            if type == _SessionLog.STATE:
+                continue
+            objects = [_convert_format(region, self._region_format) for region in objects]
+            if self._record is not None:
+                self._record.write(type, images, objects, properties)
+            image = [images.get(channel, "") for channel in self._channels]
+            return type, objects, image[0] if len(image) == 1 else image, properties
+
+    def channels(self):
+        """ Names of the channels in the order in which their paths are returned by frame """
+        return self._channels
+
+    def upcoming(self, count):
+        """
+        Returns paths of at most count frames that follow the current one without consuming them. They are only known
+        in the folder mode, with TraX the list is empty.
+
+        Returns:
+            list of image paths (or lists of paths for multiple channels)
+        """
+        if _USE_TRAX or self._replay is not None or not hasattr(self, "_frames"):
+            return []
+        return list(self._frames[self._position:self._position + count])
 
     def quit(self):
         """ Quit the tracker"""
+        if getattr(self, "_record", None) is not None:
+            self._record.write(_SessionLog.QUIT)
+            self._record.close()
+            self._record = None
+        if getattr(self, "_replay", None) is not None:
+            self._replay.close()
+            return
         if _USE_TRAX and hasattr(self, '_trax'):
             self._trax.quit()
         if not _USE_TRAX:
@@ -329,40 +607,758 @@ class VOT(object):
         """ Destructor for the tracker, calls quit. """
         self.quit()
 
+def _end(image):
+    """ True if there is no frame, frames are paths, lists of paths or decoded arrays """
+    return image is None or (not isinstance(image, np.ndarray) and len(image) == 0)
+
+def _share_frame(image, memory):
+    """ Copies a decoded frame to a shared-memory block that is reused between frames and grown when needed, returns the
+        block and a descriptor of the frame. Paths are passed as they are. """
+    if not isinstance(image, np.ndarray):
+        return memory, image
+
+    from multiprocessing import shared_memory
+
+    if memory is None or memory.size < image.nbytes:
+        if memory is not None:
+            memory.close()
+            memory.unlink()
+        memory = shared_memory.SharedMemory(create=True, size=max(image.nbytes, 1))
+
+    np.ndarray(image.shape, dtype=image.dtype, buffer=memory.buf)[...] = image
+
+    return memory, ("shm", memory.name, image.shape, image.dtype.str)
+
+def _release(tracker):
+    """ Releases the tracker of a retired object, trackers that share state with others can define a close method """
+    close = getattr(tracker, "close", None)
+    if callable(close):
+        close()
+
+def _manager_worker(connection, factory, trace=False):
+    """ Worker process of VOTManager, owns a subset of the trackers. Each request is a list of indices of trackers to
+        update, (index, region) pairs of trackers to create and (index, None) pairs of trackers to remove, the response is
+        a list of results or the index of the first object that failed with its exception. With tracing the results
+        are followed by the start and end time of each entry and the thread id. """
+    import threading
+    from multiprocessing import shared_memory
+
+    trackers = {}
+    memory = None
+    thread = threading.get_ident()
+
+    while True:
+        message = connection.recv()
+        if message is None:
+            break
+
+        image, objects = message
+
+        if isinstance(image, tuple) and len(image) == 4 and image[0] == "shm":
+            if memory is None or memory.name != image[1]:
+                if memory is not None:
+                    memory.close()
+                memory = shared_memory.SharedMemory(name=image[1])
+            # Trackers may keep views of a frame (e.g. templates) while the block is reused, so they get a copy
+            image = np.ndarray(image[2], dtype=np.dtype(image[3]), buffer=memory.buf).copy()
+            image.flags.writeable = False
+
+        results = []
+        times = []
+        try:
+            for index in objects:
+                start = time.perf_counter_ns() if trace else 0
+                if isinstance(index, tuple):
+                    index, region = index
+                    if region is None:
+                        _release(trackers.pop(index))
+                    else:
+                        trackers[index] = factory(image, region)
+                    results.append(None)
+                else:
+                    results.append(trackers[index](image))
+                if trace:
+                    times.append((start, time.perf_counter_ns()))
+            connection.send((True, (results, times, thread) if trace else results))
+        except Exception as e:
+            connection.send((False, (index, e)))
+
+    if memory is not None:
+        memory.close()
+
+class FrameReader(object):
+    """ Decodes frames with OpenCV so that all trackers get the same array instead of decoding the path each. Paths of
+        upcoming frames can be given in advance, they are then decoded in a background thread and at most a given number
+        of decoded frames is kept. Decoded frames are cached per path and decoding mode. """
+
+    def __init__(self, mode="color", prefetch=2, channels=None):
+        """ Constructor for the reader.
+
+        Args:
+            mode: Decoding of color and ir images, "color" (BGR), "gray" or an OpenCV imread flag
+            prefetch: Maximum number of frames decoded in advance
+            channels: Channel names for frames with multiple paths, depth images are always decoded as they are stored
+        """
+        import cv2
+        import concurrent.futures
+
+        self._cv2 = cv2
+        self._flags = {"color": cv2.IMREAD_COLOR, "gray": cv2.IMREAD_GRAYSCALE}.get(mode, mode)
+        self._channels = channels
+        self._prefetch = max(int(prefetch), 0)
+        self._pending = collections.OrderedDict()
+        self._executor = concurrent.futures.ThreadPoolExecutor(max_workers=1)
+
+    def _decode(self, frame):
+        if isinstance(frame, str):
+            return self._cv2.imread(frame, self._flags)
+        channels = self._channels or [None] * len(frame)
+        return [self._cv2.imread(path, self._cv2.IMREAD_ANYDEPTH if channel == "depth" else self._flags)
+                for path, channel in zip(frame, channels)]
+
+    @staticmethod
+    def _key(frame):
+        return frame if isinstance(frame, str) else tuple(frame)
+
+    def prefetch(self, frames):
+        """ Start decoding upcoming frames in the background, frames beyond the limit are ignored. """
+        for frame in frames:
+            if len(self._pending) >= self._prefetch:
+                break
+            key = (self._key(frame), self._flags)
+            if key not in self._pending:
+                self._pending[key] = self._executor.submit(self._decode, frame)
+
+    def read(self, frame):
+        """ Returns the decoded frame (a list of arrays for multiple channels), waits for it if it is being decoded. """
+        key = (self._key(frame), self._flags)
+        future = None
+
+        if key in self._pending:
+            # Frames that were prefetched before this one were skipped, they will not be requested again
+            while next(iter(self._pending)) != key:
+                self._pending.popitem(last=False)
+            future = self._pending.pop(key)
+
+        image = future.result() if future is not None else self._decode(frame)
+
+        if image is None or (isinstance(image, list) and any(channel is None for channel in image)):
+            raise RuntimeError(f"Unable to read image {frame}")
+
+        # The same arrays are given to all trackers, so they are protected from changes
+        for channel in image if isinstance(image, list) else [image]:
+            channel.flags.writeable = False
+
+        return image
+
+    def close(self):
+        """ Stop the background thread """
+        self._pending.clear()
+        self._executor.shutdown(wait=True)
+
+class Trace(object):
+    """ Spans of VOTManager in the trace event format of Chrome (chrome://tracing) and Perfetto. Each span has a name,
+        the frame number and the object index if it belongs to one object, process and thread ids. Spans are kept in
+        memory and written at the end. """
+
+    def __init__(self):
+        import threading
+
+        self._threading = threading
+        self._events = []
+        self._start = time.perf_counter_ns()
+        self.frame = 0
+
+    @staticmethod
+    def now():
+        """ Time in nanoseconds, comparable between processes """
+        return time.perf_counter_ns()
+
+    def span(self, name, start, end=None, object=None, pid=None, tid=None):
+        """ Adds a span that started at start (see now) and ends now or at end, can be called from any thread """
+        end = time.perf_counter_ns() if end is None else end
+        self._events.append((name, start, end, object, self.frame, pid or os.getpid(), tid or self._threading.get_ident()))
+
+    def write(self, filename):
+        import json
+
+        events = []
+        for name, start, end, object, frame, pid, tid in self._events:
+            args = dict(frame=frame) if object is None else dict(frame=frame, object=object)
+            events.append(dict(name=name, cat="vot", ph="X", ts=(start - self._start) / 1000, dur=(end - start) / 1000,
+                pid=pid, tid=tid, args=args))
+
+        with open(filename, "w", encoding="utf-8") as f:
+            json.dump(dict(traceEvents=events, displayTimeUnit="ms"), f)
+
+class _ResultCache(object):
+    """ Stored results of deterministic trackers for VOTManager (see VOTResultCache in vot.h). A run is keyed by the
+        identity of the tracker, the initial objects and the content of the first frame, each following frame extends the
+        key with the content of its images and the objects that start or finish on it. Runs with frames that are not
+        paths are not cached. Runs are written atomically at the end, a run that diverges from the stored one replaces
+        it. """
+
+    def __init__(self, directory, identity):
+        os.makedirs(directory, exist_ok=True)
+        self._directory = directory
+        self._identity = identity
+        self._file = None
+        self._records = []
+        self._position = 0
+        self._changed = False
+        self._active = False
+        self._hash = None
+
+    def start(self, frame, objects):
+        """ Starts a run, returns True if results of a run with the same key are stored """
+        self.finish()
+        self._records, self._position, self._changed, self._active = [], 0, False, True
+        self._hash = hashlib.blake2b(self._identity.encode("utf-8"), digest_size=16)
+        self._extend(frame, objects, [])
+        if not self._active:
+            return False
+        self._file = os.path.join(self._directory, self._hash.hexdigest() + ".run")
+        self._load()
+        return len(self._records) > 0
+
+    def next(self, frame, added, retired):
+        """ Extends the key with a frame and returns its stored results or None, stored results after a frame that does
+            not match are dropped """
+        if not self._active:
+            return None
+        self._extend(frame, added, retired)
+        if not self._active:
+            return None
+        chain = self._hash.digest()
+        if self._position < len(self._records) and self._records[self._position][0] == chain:
+            self._position += 1
+            return [_parse_stored(text) for text in self._records[self._position - 1][1]]
+        if self._position < len(self._records):
+            del self._records[self._position:]
+            self._changed = True
+        return None
+
+    def store(self, results):
+        """ Stores the results of the last frame passed to next """
+        if not self._active:
+            return
+        self._records.append((self._hash.digest(), [_encode_region(region) for region in results]))
+        self._position = len(self._records)
+        self._changed = True
+
+    def finish(self):
+        """ Writes the run if it has changed, errors are ignored since the cache is only an optimization """
+        if not self._active or not self._changed or self._file is None:
+            return
+        self._changed = False
+        temporary = f"{self._file}.{os.getpid()}"
+        try:
+            with open(temporary, "wb") as f:
+                f.write(b"VOTK")
+                for chain, results in self._records:
+                    f.write(chain + struct.pack("<I", len(results)))
+                    for text in results:
+                        data = text.encode("utf-8")
+                        f.write(struct.pack("<I", len(data)) + data)
+            os.replace(temporary, self._file)
+        except OSError:
+            if os.path.exists(temporary):
+                os.unlink(temporary)
+
+    def _extend(self, frame, objects, retired):
+        for path in [frame] if isinstance(frame, str) else frame:
+            if not isinstance(path, str):
+                self._active = False
+                return
+            try:
+                with open(path, "rb") as f:
+                    # Paths are separated, so the same bytes split differently between channels give another key
+                    self._hash.update(struct.pack("<Q", os.fstat(f.fileno()).st_size))
+                    for block in iter(lambda: f.read(1 << 16), b""):
+                        self._hash.update(block)
+            except OSError:
+                self._active = False
+                return
+        self._hash.update(struct.pack("<I", len(objects)) + "\n".join(_encode_region(region) for region in objects).encode("utf-8"))
+        self._hash.update(struct.pack(f"<I{len(retired)}i", len(retired), *retired))
+
+    def _load(self):
+        try:
+            with open(self._file, "rb") as f:
+                data = f.read()
+        except OSError:
+            return
+        try:
+            if data[:4] != b"VOTK":
+                raise ValueError()
+            position = 4
+            while position < len(data):
+                chain = data[position:position + 16]
+                count, = struct.unpack_from("<I", data, position + 16)
+                position += 20
+                results = []
+                for _ in range(count):
+                    length, = struct.unpack_from("<I", data, position)
+                    results.append(data[position + 4:position + 4 + length].decode("utf-8"))
+                    position += 4 + length
+                    if position > len(data):
+                        raise ValueError()
+                self._records.append((chain, results))
+        except (ValueError, struct.error, UnicodeDecodeError):
+            # A damaged file is ignored and replaced
+            self._records = []
+            self._changed = True
+
+def _parse_stored(text):
+    """ Parses a stored result, integer coordinates stay integers so results are reported exactly as they were """
+    if text.startswith("m"):
+        return _parse_region(text)
+    tokens = [int(t) if t.lstrip("-").isdigit() else float(t) for t in text.split(",")]
+    if len(tokens) == 1:
+        return Empty()
+    if len(tokens) == 2:
+        return Point(*tokens)
+    if len(tokens) == 4:
+        return Rectangle(*tokens)
+    return Polygon([Point(x, y) for x, y in zip(tokens[::2], tokens[1::2])])
+
+class Startup(object):
+    """ Runs expensive setup of a tracker (loading weights, building caches) in a background thread while the wrapper
+        waits for the client. Start it before the VOT handle is created, the handshake blocks until the client sends
+        the first frame, and call wait before the setup is first used. """
+
+    def __init__(self, setup, *args, **kwargs):
+        import threading
+
+        self._result = None
+        self._error = None
+        self._thread = threading.Thread(target=self._run, args=(setup, args, kwargs), daemon=True)
+        self._thread.start()
+
+    def _run(self, setup, args, kwargs):
+        try:
+            self._result = setup(*args, **kwargs)
+        except BaseException as e:
+            self._error = e
+
+    def wait(self):
+        """ Waits for the setup to finish, returns its result or raises its exception """
+        self._thread.join()
+        if self._error is not None:
+            raise self._error
+        return self._result
+
 class VOTManager(object):
     """ VOT Manager is provides a simple interface for running multiple single object trackers in parallel. Trackers should implement a factory interface. """
 
-    def __init__(self, factory, region_format, channels=None):
+    def __init__(self, factory, region_format, channels=None, workers=1, processes=False, decode=None, prefetch=2, trace=None,
+            cache=None, parameters=None, startup=None):
         """ Constructor for the manager. 
         The factory should be a callable that accepts two arguments: image and region and returns a callable that accepts a single argument (image) and returns a region.
 
+        With more than one worker the trackers are run concurrently by a persistent thread pool, this helps when trackers
+        spend most of the time in calls that release the GIL (OpenCV, numpy). Trackers that hold the GIL can be run in
+        worker processes instead, each process creates and owns a subset of the trackers, decoded frames are passed to
+        them through shared memory. In both modes results are reported in the order of objects and the first exception
+        (in that order) is raised.
+
+        Objects can start on any frame, a tracker is created for each of them on its first frame and the initialization
+        region is reported there. Trackers of retired objects are released, with their close method if they have one,
+        and Empty is reported for them.
+
+        With decode set the manager reads each frame once and passes the decoded array (or a list of arrays for multiple
+        channels) to all trackers instead of the path. In the folder mode the paths of upcoming frames are known, so the
+        next prefetch frames are decoded in a background thread while the current one is tracked.
+
+        With trace set (or the VOT_TRACE environment variable) the manager records spans for waiting for each frame,
+        decoding, initialization and update of each object and reporting, and writes them to that file as a Chrome
+        trace at the end. Without it no time is measured.
+
+        With cache set (or the VOT_RESULT_CACHE environment variable) results of deterministic trackers are stored in
+        that directory and reported without running the trackers when the same tracker runs on the same frames with the
+        same initial objects again. The tracker is identified by the source of the factory module and the main script
+        and by the parameters, which should contain everything else that changes the results. If the frames diverge
+        from a stored run, the trackers are created and catch up on the frames that were reported from the cache.
+
+        With startup set, that callable is run in a background thread (see Startup) during the handshake with the
+        client, for instance to load weights shared by all trackers. The manager waits for it before the trackers are
+        created, so worker processes started by fork inherit its results.
+
         Args:
             factory: Factory function for creating trackers
             region_format: Region format options
             channels: Channels that are supported by the tracker
+            workers: Number of concurrent workers, None for the number of cores
+            processes: Run trackers in worker processes instead of threads
+            decode: Decode frames in the manager, "color", "gray" or an OpenCV imread flag, None to pass paths
+            prefetch: Number of frames decoded in advance when decoding
+            trace: File name for a trace of the run, None to use VOT_TRACE
+            cache: Directory of stored results, None to use VOT_RESULT_CACHE
+            parameters: Parameters of the tracker that change its results (any value with a stable repr)
+            startup: Setup of the tracker that is run during the handshake, None for no setup
         """
+        # Started first, creating the handle blocks until the client sends the first frame
+        self._startup = Startup(startup) if startup is not None else None
         self._handle = VOT(region_format, channels, multiobject=True)
+        # Objects that start on later frames are added after the existing ones, retired objects keep their index
+        self._handle.accept_objects()
         self._factory = factory
+        self._workers = (os.cpu_count() or 1) if workers is None else max(int(workers), 1)
+        self._processes = processes
+        self._prefetch = prefetch
+        self._reader = FrameReader(decode, prefetch, self._handle.channels()) if decode is not None else None
+        self._trace_file = trace or os.environ.get("VOT_TRACE") or None
+        self._trace = Trace() if self._trace_file else None
+        self._cache = cache or os.environ.get("VOT_RESULT_CACHE") or None
+        self._parameters = parameters
+
+    def _identity(self):
+        """ Identity of the tracker for stored results: the factory, the content of its module and the main script and
+            the declared parameters """
+        parts = [getattr(self._factory, "__qualname__", type(self._factory).__qualname__), repr(self._parameters)]
+        for name in sorted({getattr(self._factory, "__module__", None) or "__main__", "__main__"}):
+            path = getattr(sys.modules.get(name), "__file__", None)
+            if path and os.path.isfile(path):
+                with open(path, "rb") as f:
+                    parts.append(hashlib.blake2b(f.read(), digest_size=16).hexdigest())
+        return "\n".join(parts)
+
+    def _frame(self):
+        """ Next frame from the handle """
+        trace = self._trace
+        start = trace.now() if trace else 0
+        image = self._handle.frame()
+        if trace:
+            trace.span("wait", start)
+        return image
+
+    def _decode(self, image, prefetch=True):
+        """ Decodes the frame if a reader is used, upcoming frames are prefetched for the current one """
+        if self._reader is None or _end(image):
+            return image
+        trace = self._trace
+        start = trace.now() if trace else 0
+        if prefetch:
+            self._reader.prefetch(self._handle.upcoming(self._prefetch))
+        image = self._reader.read(image)
+        if trace:
+            trace.span("decode", start)
+        return image
 
     def run(self):
         """ Run the tracker, the tracking loop is implemented in this function, so it will block until the client terminates the connection."""
+        try:
+            self._run()
+        finally:
+            if self._reader is not None:
+                self._reader.close()
+            if self._trace is not None:
+                self._trace.write(self._trace_file)
+
+    def _run(self):
         objects = self._handle.objects()
 
         # Process the first frame
-        image = self._handle.frame()
-        if not image:
+        image = self._frame()
+        if _end(image):
             return
 
-        trackers = [self._factory(image, object) for object in objects]
+        trace = self._trace
 
-        while True:
+        cache = _ResultCache(self._cache, self._identity()) if self._cache else None
+        # Frames reported from stored results, kept until the trackers have to catch up
+        history = [image] if cache is not None and cache.start(image, objects) else None
 
-            image = self._handle.frame()
-            if not image:
-                break
+        if self._startup is not None:
+            start = trace.now() if trace else 0
+            self._startup.wait()
+            if trace:
+                trace.span("startup", start)
+
+        if self._workers > 1 and self._processes:
+            runner = _ProcessRunner(self._factory, self._workers, trace)
+        elif self._workers > 1:
+            runner = _ThreadRunner(self._factory, self._workers, trace)
+        else:
+            runner = _SerialRunner(self._factory, trace)
+
+        try:
+            if history is None:
+                runner.step(self._decode(image), [], [], list(enumerate(objects)))
+            active = list(range(len(objects)))
+            count = len(objects)
+
+            while True:
+
+                if trace:
+                    trace.frame += 1
+
+                image = self._frame()
+                if _end(image):
+                    break
+
+                retired = [i for i in self._handle.retired() if i in active]
+                active = [i for i in active if i not in retired]
+                added = list(enumerate(self._handle.added(), count))
+
+                # The key is extended also after the trackers catch up, so the following frames are stored
+                status = cache.next(image, [region for _, region in added], retired) if cache is not None else None
+
+                if status is None:
+
+                    if history is not None:
+                        start = trace.now() if trace else 0
+                        runner.step(self._decode(history[0], False), [], [], list(enumerate(objects)))
+                        for frame, *arguments in history[1:]:
+                            runner.step(self._decode(frame, False), *arguments)
+                        history = None
+                        if trace:
+                            trace.span("catch up", start)
+
+                    results = runner.step(self._decode(image), active, retired, added)
+
+                    # New objects are reported with their initial region on their first frame
+                    status = [results[i] if i in results else Empty() for i in range(count)] + [region for _, region in added]
+
+                    if cache is not None:
+                        cache.store(status)
+
+                else:
+                    history.append((image, list(active), retired, added))
+
+                active += [i for i, _ in added]
+                count += len(added)
+
+                start = trace.now() if trace else 0
+                self._handle.report(status)
+                if trace:
+                    trace.span("report", start)
+
+        finally:
+            runner.close()
+            if cache is not None:
+                cache.finish()
+
+        self._handle.quit()
+
+class _SerialRunner(object):
+    """ Runs the trackers of VOTManager one after another """
+
+    def __init__(self, factory, trace=None):
+        self._factory = factory
+        self._trackers = {}
+        self._trace = trace
+
+    def _update(self, i, image):
+        if self._trace is None:
+            return self._trackers[i](image)
+        start = self._trace.now()
+        result = self._trackers[i](image)
+        self._trace.span("update", start, object=i)
+        return result
+
+    def _create(self, i, image, region):
+        if self._trace is None:
+            return self._factory(image, region)
+        start = self._trace.now()
+        tracker = self._factory(image, region)
+        self._trace.span("initialize", start, object=i)
+        return tracker
+
+    def step(self, image, active, retired, added):
+        """ Removes retired trackers, updates active ones and creates trackers for added objects (index, region), returns
+            results of active trackers by index. """
+        for i in retired:
+            _release(self._trackers.pop(i))
+        results = {i: self._update(i, image) for i in active}
+        for i, region in added:
+            self._trackers[i] = self._create(i, image, region)
+        return results
+
+    def close(self):
+        self._trackers = {}
+
+class _ThreadRunner(_SerialRunner):
+    """ Runs the trackers of VOTManager concurrently in a persistent thread pool """
+
+    def __init__(self, factory, workers, trace=None):
+        import concurrent.futures
+
+        super().__init__(factory, trace)
+        self._pool = concurrent.futures.ThreadPoolExecutor(max_workers=workers)
+
+    def step(self, image, active, retired, added):
+        for i in retired:
+            _release(self._trackers.pop(i))
+        # Results of map are collected in order, so the exception of the first failed object is raised
+        results = dict(zip(active, self._pool.map(lambda i: self._update(i, image), active)))
+        trackers = self._pool.map(lambda object: self._create(object[0], image, object[1]), added)
+        for (i, _), tracker in zip(added, trackers):
+            self._trackers[i] = tracker
+        return results
+
+    def close(self):
+        self._pool.shutdown(wait=True)
+        super().close()
+
+class _ProcessRunner(object):
+    """ Runs the trackers of VOTManager in worker processes, each process creates and owns a subset of the trackers, new
+        objects are given to the process with the fewest trackers. """
+
+    def __init__(self, factory, workers, trace=None):
+        import multiprocessing
+        from multiprocessing import resource_tracker
+
+        self._connections = []
+        self._processes = []
+        self._memory = None
+        self._owners = {}
+        self._load = [0] * workers
+        self._trace = trace
+
+        # Workers share the resource tracker of this process, otherwise each of them would unlink the shared frame
+        resource_tracker.ensure_running()
+
+        try:
+            for _ in range(workers):
+                parent, child = multiprocessing.Pipe()
+                process = multiprocessing.Process(target=_manager_worker, args=(child, factory, trace is not None), daemon=True)
+                process.start()
+                child.close()
+                self._connections.append(parent)
+                self._processes.append(process)
+        except:
+            self.close()
+            raise
+
+    def step(self, image, active, retired, added):
+        messages = [[] for _ in self._connections]
+
+        for i in retired:
+            owner = self._owners.pop(i)
+            self._load[owner] -= 1
+            messages[owner].append((i, None))
+        for i in active:
+            messages[self._owners[i]].append(i)
+        for i, region in added:
+            owner = min(range(len(self._load)), key=lambda w: self._load[w])
+            self._owners[i] = owner
+            self._load[owner] += 1
+            messages[owner].append((i, region))
+
+        self._memory, frame = _share_frame(image, self._memory)
+
+        for connection, message in zip(self._connections, messages):
+            if message:
+                connection.send((frame, message))
+
+        results = {}
+        failures = []
+        for connection, process, message in zip(self._connections, self._processes, messages):
+            if not message:
+                continue
+            ok, response = connection.recv()
+            if ok and self._trace is not None:
+                response, times, thread = response
+                for entry, (start, end) in zip(message, times):
+                    if isinstance(entry, tuple) and entry[1] is None:
+                        continue
+                    name, index = ("initialize", entry[0]) if isinstance(entry, tuple) else ("update", entry)
+                    self._trace.span(name, start, end, object=index, pid=process.pid, tid=thread)
+            if ok:
+                for entry, result in zip(message, response):
+                    if not isinstance(entry, tuple):
+                        results[entry] = result
+            else:
+                failures.append(response)
+        if failures:
+            raise min(failures, key=lambda failure: failure[0])[1]
+
+        return results
+
+    def close(self):
+        for connection in self._connections:
+            try:
+                connection.send(None)
+            except (OSError, ValueError):
+                pass
+        for process in self._processes:
+            process.join()
+        if self._memory is not None:
+            self._memory.close()
+            self._memory.unlink()
+            self._memory = None
+        self._connections = []
+        self._processes = []
+
+class FrameRing(object):
+    """ Producer side of the shared-memory frame channel. The client writes decoded frames into a ring of slots in a POSIX
+        shared-memory object and sends the tracker only a short descriptor of the slot as an URL image, the native
+        wrapper maps the object and copies the pixels out of the slot. A slot is reused after slots frames, a frame that
+        is overwritten while the tracker copies it is lost, so the ring should have more slots than frames in flight.
+        The layout is described at VOTFrameRing in vot.h."""
+
+    _HEADER = struct.Struct("<4sIIIQ")
+    _SLOT = struct.Struct("<QQiiii")
+
+    def __init__(self, capacity, slots=4, name=None):
+        """ Constructor for the ring.
+
+        Args:
+            capacity: Maximum size of a frame in bytes
+            slots: Number of slots, a slot is overwritten after that many frames
+            name: Name of the shared-memory object, generated if not given
+        """
+        from multiprocessing import shared_memory
+
+        self._capacity = (capacity + 63) // 64 * 64
+        self._slots = slots
+        self._sequence = 0
+        self._memory = shared_memory.SharedMemory(name=name, create=True, size=64 + slots * (64 + self._capacity))
+        self._HEADER.pack_into(self._memory.buf, 0, b"VOTR", 1, slots, 0, self._capacity)
+
+    @property
+    def name(self):
+        """ Name of the shared-memory object """
+        return self._memory.name
+
+    def write(self, image):
+        """ Write a frame to the next slot of the ring.
+
+        Args:
+            image: grayscale (uint8 or uint16) or RGB (uint8) image
+
+        Returns:
+            descriptor of the slot that is sent to the tracker as an URL image
+        """
+        image = np.ascontiguousarray(image)
+
+        if image.ndim == 2 and image.dtype == np.uint8:
+            format = 1
+        elif image.ndim == 2 and image.dtype == np.uint16:
+            format = 2
+        elif image.ndim == 3 and image.shape[2] == 3 and image.dtype == np.uint8:
+            format = 3
+        else:
+            raise RuntimeError(f"Unsupported image type {image.dtype} with shape {image.shape}")
+
+        if image.nbytes > self._capacity:
+            raise RuntimeError(f"Image of {image.nbytes} bytes does not fit into a slot of {self._capacity} bytes")
+
+        slot = self._sequence % self._slots
+        self._sequence += 1
+        offset = 64 + slot * (64 + self._capacity)
 
-            status = [tracker(image) for tracker in trackers]
+        # The slot is invalid while it is being written
+        self._SLOT.pack_into(self._memory.buf, offset, 0, 0, 0, 0, 0, 0)
+        np.frombuffer(self._memory.buf, dtype=np.uint8, count=image.nbytes, offset=offset + 64)[:] = image.reshape(-1).view(np.uint8)
+        self._SLOT.pack_into(self._memory.buf, offset, self._sequence, image.nbytes, image.shape[1], image.shape[0], format, 0)
 
-            self._handle.report(status)
+        return f"shm:{self.name}?slot={slot}&seq={self._sequence}&size={image.nbytes}"
 
-        self._handle.quit()
\ No newline at end of file
+    def close(self):
+        """ Close and remove the shared-memory object """
+        if self._memory is not None:
+            self._memory.close()
+            self._memory.unlink()
+            self._memory = None